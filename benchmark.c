@@ -0,0 +1,549 @@
+#include <ctype.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "parser.h"
+#include "dictionary.h"
+#include "search.h"
+#include "hashmap.h"
+#include "hash.h"
+#include "linkedlist.h"
+#include "box.h"
+
+// Number of times every query is repeated.
+const int bench_rounds = 5;
+
+// Number of random puzzles solved by the search benchmark.
+const int bench_puzzles = 200;
+
+// Queries shared by all benchmarks, collected from the dictionary.
+char** queries;
+int query_count;
+int query_capacity;
+
+void bench_add_query(const char* query);
+void bench_collect_queries(const char* key, void* data);
+
+// Declare struct to be used for passing parameters to a benchmark thread.
+typedef struct {
+  const Dictionary* dict;
+  pthread_mutex_t* lock;
+  int lo;
+  int hi;
+  long found;
+} bench_params;
+
+int bench_validate_hashmap(HashMap* hm, char* word);
+void bench_hashmap_vs_trie(HashMap* hm, Dictionary* dict, double hm_build, double trie_build);
+void bench_packed(Dictionary* dict);
+void bench_filter(Dictionary* dict);
+void bench_search(Dictionary* dict);
+double bench_search_kernel(Puzzle** puzzles, Dictionary** boards, void (*kernel)(const Search*, const PuzzlePath*, int), long* found);
+double bench_search_pool(Puzzle** puzzles, Dictionary** boards, ThreadPool* pool, long* found);
+void bench_count_word(PuzzlePath* path, void* data);
+Puzzle* bench_random_puzzle();
+void bench_hash_functions(HashMap* hm, const char corpus_file_name[]);
+void bench_hash_keys(const char* name, char** keys, int count);
+void bench_collect_key(const char* key, void* data);
+void bench_thread_scaling(Dictionary* dict, int max_threads);
+void bench_parallel_loader(Dictionary* dict, const char file_name[], int max_threads);
+double bench_lookup_threads(Dictionary* dict, int tc, pthread_mutex_t* lock);
+void* bench_lookup_thread(void* params);
+
+double bench_seconds();
+void destroy_wordlist(void* data);
+
+/**
+ * Benchmarks for the datastructures used by the solver.
+ */
+int main(int argc, char* argv[]) {
+  if (argc < 2) {
+    printf("Usage: './benchmark <dictionary_file_url> [<text_file_url>]'\n");
+    return 3;
+  }
+  HashMap* hm = create_hashmap(1024);
+  set_hash_function(hm, hash_polynomial);
+  double start = bench_seconds();
+  parse_dictionary_from_file(argv[1], hm);
+  double hm_build = bench_seconds() - start;
+
+  start = bench_seconds();
+  // Truncate entries like the hashmap parser does, so their results agree.
+  Dictionary* dict = parse_dictionary_trie_from_file(argv[1], PARSER_POLICY_TRUNCATE);
+  if (dict == NULL) return 1;
+  double trie_build = bench_seconds() - start;
+
+  query_count = 0;
+  query_capacity = 1024;
+  queries = malloc(query_capacity * sizeof(char*));
+  iterate(hm, bench_collect_queries);
+
+  bench_hashmap_vs_trie(hm, dict, hm_build, trie_build);
+  bench_packed(dict);
+  bench_filter(dict);
+  bench_search(dict);
+  bench_hash_functions(hm, (argc > 2) ? argv[2] : argv[1]);
+  bench_thread_scaling(dict, sysconf(_SC_NPROCESSORS_ONLN));
+  bench_parallel_loader(dict, argv[1], sysconf(_SC_NPROCESSORS_ONLN));
+
+  for (int i = 0; i < query_count; i++) {
+    free(queries[i]);
+  }
+  free(queries);
+  dict_destroy(dict);
+  delete_hashmap(hm, destroy_wordlist);
+  return 0;
+}
+
+/**
+ * Compare the three letter prefix hashmap with the trie, using every prefix
+ * of every word as a query, once as is and once with its last letter changed.
+ */
+void bench_hashmap_vs_trie(HashMap* hm, Dictionary* dict, double hm_build, double trie_build) {
+  long hm_found = 0;
+  double start = bench_seconds();
+  for (int r = 0; r < bench_rounds; r++) {
+    for (int i = 0; i < query_count; i++) {
+      hm_found += bench_validate_hashmap(hm, queries[i]);
+    }
+  }
+  double hm_time = bench_seconds() - start;
+
+  long trie_found = 0;
+  start = bench_seconds();
+  for (int r = 0; r < bench_rounds; r++) {
+    for (int i = 0; i < query_count; i++) {
+      trie_found += dict_lookup(dict, queries[i]);
+    }
+  }
+  double trie_time = bench_seconds() - start;
+
+  long lookups = (long) query_count * bench_rounds;
+  printf("Queries: %i (%s)\n", query_count, (hm_found == trie_found) ? "results agree" : "RESULTS DIFFER");
+  printf("hashmap: build %8.3f ms, lookup %8.1f ns\n", hm_build * 1e3, hm_time * 1e9 / lookups);
+  printf("trie:    build %8.3f ms, lookup %8.1f ns (%u nodes)\n", trie_build * 1e3, trie_time * 1e9 / lookups, dict->size);
+}
+
+/**
+ * Compare the depth-first search kernel specialized for 4x4 puzzles
+ * with the generic one, solving the same random puzzles single threaded.
+ */
+void bench_search(Dictionary* dict) {
+  srand(42);
+  Puzzle* puzzles[bench_puzzles];
+  Dictionary* boards[bench_puzzles];
+  for (int i = 0; i < bench_puzzles; i++) {
+    puzzles[i] = bench_random_puzzle();
+    DictionaryFilter filter;
+    pz_build_filter(puzzles[i], &filter);
+    boards[i] = dict_filter(dict, &filter);
+  }
+
+  long generic_found[2] = {0, 0};
+  long kernel_found[2] = {0, 0};
+  double generic_time = bench_search_kernel(puzzles, boards, search_generic_enter, generic_found);
+  double kernel_time = bench_search_kernel(puzzles, boards, search_4x4_enter, kernel_found);
+  int same = generic_found[0] == kernel_found[0] && generic_found[1] == kernel_found[1];
+  long solves = (long) bench_puzzles * bench_rounds;
+  printf("search:  generic %8.1f us, 4x4 kernel %8.1f us per puzzle, %.1fx faster (%s)\n",
+    generic_time * 1e6 / solves, kernel_time * 1e6 / solves, generic_time / kernel_time,
+    same ? "results agree" : "RESULTS DIFFER");
+
+  // The workers of the thread pool are started once for all puzzles.
+  int max_threads = sysconf(_SC_NPROCESSORS_ONLN);
+  printf("threads   search (us/puzzle)   speedup\n");
+  for (int tc = 1; tc <= max_threads; tc = (tc * 2 > max_threads && tc < max_threads) ? max_threads : tc * 2) {
+    ThreadPool* pool = tp_create(tc, search_pool_flush, search_pool_drain);
+    long pool_found[2] = {0, 0};
+    double pool_time = bench_search_pool(puzzles, boards, pool, pool_found);
+    tp_destroy(pool);
+    same = pool_found[0] == kernel_found[0] && pool_found[1] == kernel_found[1];
+    printf("%7i   %18.1f   %6.1fx%s\n", tc, pool_time * 1e6 / solves, kernel_time / pool_time,
+      same ? "" : " (RESULTS DIFFER)");
+  }
+
+  for (int i = 0; i < bench_puzzles; i++) {
+    dict_destroy(boards[i]);
+    pz_destroy(puzzles[i]);
+  }
+  pz_pool_drain();
+}
+
+// Solve all puzzles with a kernel, counting the words found and their letters.
+double bench_search_kernel(Puzzle** puzzles, Dictionary** boards, void (*kernel)(const Search*, const PuzzlePath*, int), long* found) {
+  PuzzlePath path;
+  pz_init_path(&path);
+  double start = bench_seconds();
+  for (int r = 0; r < bench_rounds; r++) {
+    for (int i = 0; i < bench_puzzles; i++) {
+      DictionaryMarks* marks = dict_marks_create(boards[i]);
+      Search search = {puzzles[i], boards[i], marks, 3, bench_count_word, found, NULL};
+      for (int id = 0; id < 16; id++) {
+        kernel(&search, &path, id);
+      }
+      dict_marks_destroy(marks);
+    }
+  }
+  return bench_seconds() - start;
+}
+
+// Solve all puzzles with the workers of a thread pool.
+double bench_search_pool(Puzzle** puzzles, Dictionary** boards, ThreadPool* pool, long* found) {
+  double start = bench_seconds();
+  for (int r = 0; r < bench_rounds; r++) {
+    for (int i = 0; i < bench_puzzles; i++) {
+      DictionaryMarks* marks = dict_marks_create(boards[i]);
+      Search search = {puzzles[i], boards[i], marks, 3, bench_count_word, found, pool};
+      search_parallel(&search);
+      dict_marks_destroy(marks);
+    }
+  }
+  return bench_seconds() - start;
+}
+
+// Words are counted by the workers of a thread pool at the same time.
+void bench_count_word(PuzzlePath* path, void* data) {
+  long* found = (long*) data;
+  __atomic_add_fetch(&found[0], 1, __ATOMIC_RELAXED);
+  __atomic_add_fetch(&found[1], path->length, __ATOMIC_RELAXED);
+}
+
+/**
+ * Create a 4x4 puzzle of random letters, drawn about as often as in Dutch,
+ * with an occasional cell of two letters or of either of two letters.
+ */
+Puzzle* bench_random_puzzle() {
+  const char* letters = "eeeeeeeeennnnnaaaaatttttiiiirrrrooooddddsssllllggkkvvhhmmuubbppwjzcf";
+  int count = strlen(letters);
+  Puzzle* pz = pz_create(4);
+  for (int id = 0; id < 16; id++) {
+    int kind = rand() % 20;
+    PuzzleCell cell = {id, (kind == 0) ? 1 : (kind == 1) ? 2 : 0, letters[rand() % count], '\0'};
+    if (cell.type != 0) cell.c2 = letters[rand() % count];
+    pz_add_cell(pz, &cell);
+  }
+  return pz;
+}
+
+/**
+ * Compare the memory and lookup time of the packed dictionary with the trie.
+ */
+void bench_packed(Dictionary* dict) {
+  double start = bench_seconds();
+  Dictionary* packed = dict_pack(dict);
+  double pack_build = bench_seconds() - start;
+
+  long same = 0;
+  for (int r = 0; r < bench_rounds; r++) {
+    for (int i = 0; i < query_count; i++) {
+      same += dict_lookup(packed, queries[i]) == dict_lookup(dict, queries[i]);
+    }
+  }
+  long lookups = (long) query_count * bench_rounds;
+
+  start = bench_seconds();
+  long found = 0;
+  for (int r = 0; r < bench_rounds; r++) {
+    for (int i = 0; i < query_count; i++) {
+      found += dict_lookup(packed, queries[i]);
+    }
+  }
+  double pack_time = bench_seconds() - start;
+  printf("packed:  build %8.3f ms, lookup %8.1f ns (%s)\n", pack_build * 1e3, pack_time * 1e9 / lookups,
+    (same == lookups) ? "results agree" : "RESULTS DIFFER");
+  printf("memory:  trie %zu KiB, packed %zu KiB\n", dict_memory_size(dict) / 1024, dict_memory_size(packed) / 1024);
+  dict_destroy(packed);
+}
+
+/**
+ * Compare pruning the dictionary for random puzzles by walking the trie,
+ * which drops every subtree that fails, with scanning the packed dictionary
+ * word by word, which checks the letter counts eight at a time.
+ */
+void bench_filter(Dictionary* dict) {
+  Dictionary* packed = dict_pack(dict);
+  srand(7);
+  Puzzle* puzzles[bench_puzzles];
+  DictionaryFilter filters[bench_puzzles];
+  for (int i = 0; i < bench_puzzles; i++) {
+    puzzles[i] = bench_random_puzzle();
+    pz_build_filter(puzzles[i], &filters[i]);
+  }
+
+  long trie_words = 0;
+  double start = bench_seconds();
+  for (int i = 0; i < bench_puzzles; i++) {
+    Dictionary* board = dict_filter(dict, &filters[i]);
+    trie_words += board->words;
+    dict_destroy(board);
+  }
+  double trie_time = bench_seconds() - start;
+
+  long packed_words = 0;
+  start = bench_seconds();
+  for (int i = 0; i < bench_puzzles; i++) {
+    Dictionary* board = dict_filter(packed, &filters[i]);
+    packed_words += board->words;
+    dict_destroy(board);
+  }
+  double packed_time = bench_seconds() - start;
+  printf("filter:  trie %8.1f us, packed %8.1f us per puzzle (%s)\n",
+    trie_time * 1e6 / bench_puzzles, packed_time * 1e6 / bench_puzzles,
+    (trie_words == packed_words) ? "results agree" : "RESULTS DIFFER");
+
+  for (int i = 0; i < bench_puzzles; i++) {
+    pz_destroy(puzzles[i]);
+  }
+  dict_destroy(packed);
+}
+
+// Hash functions compared by the benchmark.
+const struct {
+  const char* name;
+  HashFunction function;
+} bench_hashes[] = {
+  {"sum", hash},
+  {"polynomial", hash_polynomial},
+  {"fnv1a", hash_fnv1a},
+  {"words", hash_words},
+  {"short", hash_short},
+};
+
+// Keys collected from a hashmap.
+char** bench_keys;
+int bench_key_count;
+int bench_key_capacity;
+
+void bench_collect_key(const char* key, void* data) {
+  if (bench_key_count == bench_key_capacity) {
+    bench_key_capacity *= 2;
+    bench_keys = realloc(bench_keys, bench_key_capacity * sizeof(char*));
+  }
+  bench_keys[bench_key_count++] = (char*) key;
+}
+
+/**
+ * Compare the hash functions on the three letter prefixes of the dictionary
+ * and on the distinct words of a text, as counted by wordcount.
+ */
+void bench_hash_functions(HashMap* hm, const char corpus_file_name[]) {
+  bench_key_capacity = 1024;
+  bench_keys = malloc(bench_key_capacity * sizeof(char*));
+  bench_key_count = 0;
+  iterate(hm, bench_collect_key);
+  bench_hash_keys("prefixes", bench_keys, bench_key_count);
+
+  // Split the text into words like wordcount does.
+  HashMap* words = create_hashmap(1024);
+  FILE* fp = fopen(corpus_file_name, "r");
+  if (fp == NULL) {
+    printf("Error: unable to open file '%s'\n", corpus_file_name);
+    exit(-1);
+  }
+  char word[256];
+  int length = 0;
+  int c;
+  do {
+    c = fgetc(fp);
+    if (c != EOF && isalpha(c) && length < (int) sizeof(word) - 1) {
+      word[length++] = c;
+    } else if (length > 0 && (c == EOF || !isalpha(c))) {
+      word[length] = '\0';
+      insert_data(words, word, NULL, NULL);
+      length = 0;
+    }
+  } while (c != EOF);
+  fclose(fp);
+
+  bench_key_count = 0;
+  iterate(words, bench_collect_key);
+  bench_hash_keys("text", bench_keys, bench_key_count);
+  delete_hashmap(words, NULL);
+  free(bench_keys);
+}
+
+/**
+ * Measure the throughput of every hash function on a set of distinct keys,
+ * and how evenly it spreads them over a table with a bucket per key
+ * (1.00 is as good as random, higher means more collisions).
+ */
+void bench_hash_keys(const char* name, char** keys, int count) {
+  size_t size = 1;
+  while (size < (size_t) count) size *= 2;
+  unsigned int* loads = malloc(size * sizeof(unsigned int));
+  printf("hash %-10s %8s %11s %9s %9s\n", name, "keys", "rate (M/s)", "quality", "max load");
+  for (int f = 0; f < (int) (sizeof(bench_hashes) / sizeof(bench_hashes[0])); f++) {
+    HashFunction function = bench_hashes[f].function;
+    // Hash at least a few million keys, so the time can be measured.
+    int rounds = (count > 0 && 4000000 / count > bench_rounds) ? 4000000 / count : bench_rounds;
+    unsigned int sink = 0;
+    double start = bench_seconds();
+    for (int r = 0; r < rounds; r++) {
+      for (int i = 0; i < count; i++) {
+        sink += function(keys[i]);
+      }
+    }
+    double elapsed = bench_seconds() - start;
+
+    memset(loads, 0, size * sizeof(unsigned int));
+    unsigned int max_load = 0;
+    double probes = 0;
+    for (int i = 0; i < count; i++) {
+      unsigned int load = ++loads[function(keys[i]) & (size - 1)];
+      if (load > max_load) max_load = load;
+      probes += load;
+    }
+    // Expected number of comparisons for a random hash function.
+    double expected = count / (2.0 * size) * (count + 2.0 * size - 1);
+    // The sum is printed nowhere, it only keeps the calls from being optimized away.
+    if (sink == 1) printf(" ");
+    printf("     %-10s %8i %11.1f %9.2f %9u\n", bench_hashes[f].name, count,
+      (double) count * rounds / elapsed / 1e6, probes / expected, max_load);
+  }
+  free(loads);
+}
+
+/**
+ * Measure the lookup throughput of the trie for 1 up to max_threads threads,
+ * both reading it without locking and behind one global mutex.
+ */
+void bench_thread_scaling(Dictionary* dict, int max_threads) {
+  pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+  printf("threads   lock-free (M/s)   mutex (M/s)\n");
+  for (int tc = 1; tc <= max_threads; tc = (tc * 2 > max_threads && tc < max_threads) ? max_threads : tc * 2) {
+    double lock_free = bench_lookup_threads(dict, tc, NULL);
+    double locked = bench_lookup_threads(dict, tc, &lock);
+    printf("%7i   %15.1f   %11.1f\n", tc, lock_free, locked);
+  }
+}
+
+/**
+ * Measure the time to load a plain text dictionary with the parallel loader,
+ * and check that it builds exactly the same trie as the sequential parser.
+ */
+void bench_parallel_loader(Dictionary* dict, const char file_name[], int max_threads) {
+  printf("threads   load (ms)\n");
+  for (int tc = 1; tc <= max_threads; tc = (tc * 2 > max_threads && tc < max_threads) ? max_threads : tc * 2) {
+    double start = bench_seconds();
+    Dictionary* loaded = parse_dictionary_parallel_from_file(file_name, tc, PARSER_POLICY_TRUNCATE);
+    if (loaded == NULL) return;
+    double elapsed = bench_seconds() - start;
+    int same = loaded->size == dict->size && loaded->words == dict->words
+      && memcmp(loaded->nodes, dict->nodes, dict->size * sizeof(DictionaryNode)) == 0;
+    printf("%7i   %9.3f%s\n", tc, elapsed * 1e3, same ? "" : " (DIFFERENT TRIE)");
+    dict_destroy(loaded);
+  }
+}
+
+/**
+ * Split all queries over a number of threads and return the number of
+ * lookups per second, in millions.
+ */
+double bench_lookup_threads(Dictionary* dict, int tc, pthread_mutex_t* lock) {
+  pthread_t threads[tc];
+  bench_params params[tc];
+  double start = bench_seconds();
+  for (int tid = 0; tid < tc; tid++) {
+    params[tid] = (bench_params) {dict, lock, (long) query_count * tid / tc, (long) query_count * (tid + 1) / tc, 0};
+    if (pthread_create(&threads[tid], NULL, bench_lookup_thread, &params[tid])) {
+      printf("Error: failed to create thread %i.\n", tid);
+      exit(1);
+    }
+  }
+  for (int tid = 0; tid < tc; tid++) {
+    pthread_join(threads[tid], NULL);
+  }
+  double elapsed = bench_seconds() - start;
+  return (double) query_count * bench_rounds / elapsed / 1e6;
+}
+
+void* bench_lookup_thread(void* params) {
+  bench_params* p = (bench_params*) params;
+  // Count locally, since the parameters of the threads share cache lines.
+  long found = 0;
+  for (int r = 0; r < bench_rounds; r++) {
+    for (int i = p->lo; i < p->hi; i++) {
+      if (p->lock != NULL) pthread_mutex_lock(p->lock);
+      found += dict_lookup(p->dict, queries[i]);
+      if (p->lock != NULL) pthread_mutex_unlock(p->lock);
+    }
+  }
+  p->found = found;
+  return NULL;
+}
+
+void bench_add_query(const char* query) {
+  if (query_count == query_capacity) {
+    query_capacity *= 2;
+    queries = realloc(queries, query_capacity * sizeof(char*));
+  }
+  queries[query_count++] = strdup(query);
+}
+
+void bench_collect_queries(const char* key, void* data) {
+  LinkedNode* node = ((LinkedList) data)->head;
+  while (node != NULL) {
+    char* word = strdup((char*) node->data);
+    int length = strlen(word);
+    for (int i = length; i >= 3; i--) {
+      word[i] = '\0';
+      bench_add_query(word);
+      char last = word[i - 1];
+      word[i - 1] = (last == 'z') ? 'a' : last + 1;
+      bench_add_query(word);
+      word[i - 1] = last;
+    }
+    free(word);
+    node = node->next;
+  }
+}
+
+/**
+ * The original lookup of the solver: a linear scan through
+ * all words sharing the three letter prefix of a word.
+ */
+int bench_validate_hashmap(HashMap* hm, char* word) {
+  char prefix[4];
+  for (int i = 0; i < 3; i++) {
+    prefix[i] = word[i];
+  }
+  prefix[3] = '\0';
+
+  LinkedList candidates = (LinkedList) get_data(hm, prefix);
+  if (candidates == NULL) return 0;
+  LinkedNode* candidate = candidates->head;
+
+  int matches = 0;
+  while (candidate != NULL) {
+    char* other = (char*) candidate->data;
+    int pos = 3;
+    while (word[pos] != '\0' && other[pos] != '\0') {
+      if (word[pos] != other[pos]) {
+        if (pos - 3 < matches || word[pos] < other[pos]) return 0;
+        break;
+      }
+      if (pos - 2 > matches) matches = pos - 2;
+      pos++;
+    }
+    if (word[pos] == '\0') {
+      return (other[pos] == '\0') ? 2 : 1;
+    }
+    candidate = candidate->next;
+  }
+  return 0;
+}
+
+double bench_seconds() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+void destroy_wordlist(void* data) {
+  LinkedList wordlist = (LinkedList) data;
+  ll_destroy(wordlist, destroy_char);
+}
@@ -0,0 +1,929 @@
+#include <fcntl.h>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "dictionary.h"
+#include "mergesort.h"
+
+// Datastructure for a pending node while building the trie:
+// the node and the range of sorted words sharing its prefix.
+typedef struct DictionaryFrame DictionaryFrame;
+struct DictionaryFrame {
+  uint32_t node;
+  int lo;
+  int hi;
+  int depth;
+};
+
+// Datastructure for building the subtrees below the root in parallel,
+// one part per first letter.
+typedef struct DictionaryBuild DictionaryBuild;
+struct DictionaryBuild {
+  char** words;
+  uint32_t* languages;
+  int ranges[DICT_LETTERS][2];
+  uint32_t letters;
+  Dictionary* parts[DICT_LETTERS];
+  int next;
+};
+
+Dictionary* dict_alloc(uint32_t* capacity) {
+  Dictionary* dict = malloc(sizeof(Dictionary));
+  *capacity = 1024;
+  dict->size = 0;
+  dict->words = 0;
+  dict->languages = 1;
+  dict->nodes = malloc(*capacity * sizeof(DictionaryNode));
+  dict->image = NULL;
+  dict->image_size = 0;
+  dict->packed = NULL;
+  return dict;
+}
+
+uint32_t dict_alloc_nodes(Dictionary* dict, uint32_t* capacity, uint32_t count) {
+  while (dict->size + count > *capacity) {
+    *capacity *= 2;
+    dict->nodes = realloc(dict->nodes, *capacity * sizeof(DictionaryNode));
+  }
+  uint32_t first = dict->size;
+  memset(&dict->nodes[first], 0, count * sizeof(DictionaryNode));
+  dict->size += count;
+  return first;
+}
+
+/**
+ * Split a sorted range of words sharing a prefix of a given length
+ * by the letter following that prefix. Returns a bitmask of the letters found.
+ */
+uint32_t dict_split(char** words, int lo, int hi, int depth, int ranges[][2]) {
+  uint32_t letters = 0;
+  int i = lo;
+  while (i < hi) {
+    int letter = dict_letter(words[i][depth]);
+    int j = i + 1;
+    while (j < hi && dict_letter(words[j][depth]) == letter) j++;
+    // Words ending here or continuing with a non letter are skipped.
+    if (letter >= 0) {
+      letters |= (1u << letter);
+      ranges[letter][0] = i;
+      ranges[letter][1] = j;
+    }
+    i = j;
+  }
+  return letters;
+}
+
+/**
+ * Build the subtree below a node from the sorted range of words sharing its prefix.
+ * Depth first, so the children of every node are allocated
+ * as one contiguous block close to their parent.
+ */
+void dict_build(Dictionary* dict, uint32_t* capacity, char** words, uint32_t* languages, DictionaryFrame root) {
+  int stack_capacity = 64;
+  int stack_size = 0;
+  DictionaryFrame* stack = malloc(stack_capacity * sizeof(DictionaryFrame));
+  stack[stack_size++] = root;
+
+  while (stack_size > 0) {
+    DictionaryFrame frame = stack[--stack_size];
+    int d = frame.depth;
+
+    // Words ending here sort before all longer words with the same prefix.
+    if (frame.lo < frame.hi && words[frame.lo][d] == '\0') {
+      DictionaryNode* node = &dict->nodes[frame.node];
+      node->children |= DICT_TERMINAL;
+      for (int i = frame.lo; i < frame.hi && words[i][d] == '\0'; i++) {
+        node->languages |= (languages != NULL) ? languages[i] : 1;
+      }
+      dict->words++;
+    }
+
+    int ranges[DICT_LETTERS][2];
+    uint32_t letters = dict_split(words, frame.lo, frame.hi, d, ranges);
+    if (letters == 0) continue;
+
+    uint32_t first = dict_alloc_nodes(dict, capacity, __builtin_popcount(letters));
+    dict->nodes[frame.node].children |= letters;
+    dict->nodes[frame.node].first = first;
+
+    // Push the children in reverse, so the first child is built first.
+    for (int letter = DICT_LETTERS - 1; letter >= 0; letter--) {
+      if (!(letters & (1u << letter))) continue;
+      if (stack_size == stack_capacity) {
+        stack_capacity *= 2;
+        stack = realloc(stack, stack_capacity * sizeof(DictionaryFrame));
+      }
+      uint32_t child = first + __builtin_popcount(letters & ((1u << letter) - 1));
+      stack[stack_size++] = (DictionaryFrame) {child, ranges[letter][0], ranges[letter][1], d + 1};
+    }
+  }
+
+  free(stack);
+}
+
+/**
+ * Thread: build the parts of a dictionary for the first letters
+ * that have not been claimed by another thread yet.
+ */
+void* dict_build_parts(void* params) {
+  DictionaryBuild* build = (DictionaryBuild*) params;
+  int letter;
+  while ((letter = __sync_fetch_and_add(&build->next, 1)) < DICT_LETTERS) {
+    if (!(build->letters & (1u << letter))) continue;
+    uint32_t capacity;
+    Dictionary* part = dict_alloc(&capacity);
+    dict_alloc_nodes(part, &capacity, 1);
+    DictionaryFrame root = {DICT_ROOT, build->ranges[letter][0], build->ranges[letter][1], 1};
+    dict_build(part, &capacity, build->words, build->languages, root);
+    build->parts[letter] = part;
+  }
+  return NULL;
+}
+
+/**
+ * Build a dictionary from an array of lowercase words.
+ * The array is sorted in place. Duplicates and words containing
+ * characters outside of the alphabet are ignored.
+ */
+Dictionary* dict_create(char** words, int count) {
+  return dict_create_parallel(words, count, 1);
+}
+
+/**
+ * Build a dictionary like dict_create, using a number of threads.
+ * Every thread builds the subtrees for some first letters,
+ * which are then concatenated behind the root.
+ */
+Dictionary* dict_create_parallel(char** words, int count, int tc) {
+  if (count > 1 && !dict_words_sorted(words, count)) {
+    mergesort((void**) words, count, &dict_compare_words);
+  }
+  return dict_create_sorted(words, NULL, count, tc);
+}
+
+/**
+ * Build a dictionary from a sorted array of lowercase words, with for every
+ * word the bitmask of the languages it belongs to, or NULL for one language.
+ */
+Dictionary* dict_create_sorted(char** words, uint32_t* languages, int count, int tc) {
+  uint32_t capacity;
+  Dictionary* dict = dict_alloc(&capacity);
+  dict_alloc_nodes(dict, &capacity, 1);
+  DictionaryFrame root = {DICT_ROOT, 0, count, 0};
+  if (tc <= 1) {
+    dict_build(dict, &capacity, words, languages, root);
+    dict->nodes = realloc(dict->nodes, dict->size * sizeof(DictionaryNode));
+    return dict;
+  }
+
+  DictionaryBuild build;
+  build.words = words;
+  build.languages = languages;
+  build.letters = dict_split(words, 0, count, 0, build.ranges);
+  build.next = 0;
+  memset(build.parts, 0, sizeof(build.parts));
+
+  pthread_t threads[tc];
+  for (int tid = 0; tid < tc; tid++) {
+    if (pthread_create(&threads[tid], NULL, dict_build_parts, &build)) {
+      printf("Error: failed to create thread %i.\n", tid);
+      exit(1);
+    }
+  }
+  for (int tid = 0; tid < tc; tid++) {
+    if (pthread_join(threads[tid], NULL)) {
+      printf("Error: failed to join thread %i.\n", tid);
+      exit(2);
+    }
+  }
+
+  // Concatenate the parts. The root of every part becomes a child of the root,
+  // the rest of it is moved behind the children of the root.
+  int k = __builtin_popcount(build.letters);
+  uint32_t size = 1 + k;
+  for (int letter = 0; letter < DICT_LETTERS; letter++) {
+    if (build.parts[letter] != NULL) size += build.parts[letter]->size - 1;
+  }
+  free(dict->nodes);
+  dict->nodes = malloc(size * sizeof(DictionaryNode));
+  dict->size = size;
+  dict->nodes[DICT_ROOT].children = build.letters;
+  dict->nodes[DICT_ROOT].first = 1;
+  dict->nodes[DICT_ROOT].languages = 0;
+  if (count > 0 && words[0][0] == '\0') {
+    dict->nodes[DICT_ROOT].children |= DICT_TERMINAL;
+    for (int i = 0; i < count && words[i][0] == '\0'; i++) {
+      dict->nodes[DICT_ROOT].languages |= (languages != NULL) ? languages[i] : 1;
+    }
+    dict->words++;
+  }
+
+  uint32_t child = 1;
+  uint32_t base = 1 + k;
+  for (int letter = 0; letter < DICT_LETTERS; letter++) {
+    Dictionary* part = build.parts[letter];
+    if (part == NULL) continue;
+    for (uint32_t i = 0; i < part->size; i++) {
+      DictionaryNode node = part->nodes[i];
+      if (node.children & ~DICT_TERMINAL) node.first += base - 1;
+      dict->nodes[(i == 0) ? child : base + i - 1] = node;
+    }
+    dict->words += part->words;
+    base += part->size - 1;
+    child++;
+    dict_destroy(part);
+  }
+  return dict;
+}
+
+/**
+ * Check whether an array of words is sorted already, so sorting can be skipped.
+ */
+int dict_words_sorted(char** words, int count) {
+  for (int i = 1; i < count; i++) {
+    if (strcmp(words[i - 1], words[i]) > 0) return 0;
+  }
+  return 1;
+}
+
+/**
+ * Get the number of bytes of memory used by a dictionary.
+ */
+size_t dict_memory_size(const Dictionary* dict) {
+  size_t size = sizeof(Dictionary) + dict->size * sizeof(DictionaryNode);
+  if (dict->packed != NULL) {
+    size += sizeof(DictionaryPacked) + dict->packed->size + dict->packed->blocks * sizeof(uint32_t);
+    if (dict->packed->languages != NULL) size += dict->words * sizeof(uint32_t);
+  }
+  return size;
+}
+
+void dict_destroy(Dictionary* dict) {
+  if (dict->packed != NULL) {
+    free(dict->packed->offsets);
+    free(dict->packed->data);
+    free(dict->packed->languages);
+    free(dict->packed);
+  }
+  if (dict->image != NULL) {
+    munmap(dict->image, dict->image_size);
+  } else {
+    free(dict->nodes);
+  }
+  free(dict);
+}
+
+/**
+ * Build a packed dictionary from a sorted array of lowercase words without
+ * duplicates, with for every word the bitmask of the languages it belongs to,
+ * or NULL for one language. Words are cut off at DICT_MAX_WORD_LENGTH.
+ */
+Dictionary* dict_create_packed(char** words, uint32_t* languages, int count) {
+  Dictionary* dict = malloc(sizeof(Dictionary));
+  dict->size = 0;
+  dict->words = count;
+  dict->languages = 1;
+  dict->nodes = NULL;
+  dict->image = NULL;
+  dict->image_size = 0;
+
+  DictionaryPacked* packed = malloc(sizeof(DictionaryPacked));
+  packed->blocks = (count + DICT_BLOCK_WORDS - 1) / DICT_BLOCK_WORDS;
+  packed->offsets = malloc((packed->blocks > 0 ? packed->blocks : 1) * sizeof(uint32_t));
+  packed->languages = NULL;
+  if (languages != NULL) {
+    packed->languages = malloc((count > 0 ? count : 1) * sizeof(uint32_t));
+    memcpy(packed->languages, languages, count * sizeof(uint32_t));
+  }
+
+  size_t capacity = 4096;
+  size_t size = 0;
+  uint8_t* data = malloc(capacity);
+  const char* previous = "";
+  int previous_length = 0;
+  for (int i = 0; i < count; i++) {
+    int length = strnlen(words[i], DICT_MAX_WORD_LENGTH);
+    int shared = 0;
+    if (i % DICT_BLOCK_WORDS == 0) {
+      packed->offsets[i / DICT_BLOCK_WORDS] = size;
+    } else {
+      while (shared < length && shared < previous_length && words[i][shared] == previous[shared]) shared++;
+    }
+    if (size + length + 2 > capacity) {
+      while (size + length + 2 > capacity) capacity *= 2;
+      data = realloc(data, capacity);
+    }
+    if (i % DICT_BLOCK_WORDS != 0) data[size++] = shared;
+    data[size++] = length - shared;
+    memcpy(&data[size], &words[i][shared], length - shared);
+    size += length - shared;
+    previous = words[i];
+    previous_length = length;
+  }
+  packed->data = realloc(data, (size > 0) ? size : 1);
+  packed->size = size;
+  dict->packed = packed;
+  return dict;
+}
+
+/**
+ * Decode the next word of a block into word, which holds the previous word.
+ * Sets the length of the word and the number of letters it shares with the
+ * previous one, and returns the position of the word following it.
+ */
+const uint8_t* dict_packed_next(const uint8_t* p, int first, char* word, int* length, int* shared) {
+  *shared = first ? 0 : *p++;
+  int suffix = *p++;
+  memcpy(&word[*shared], p, suffix);
+  *length = *shared + suffix;
+  return p + suffix;
+}
+
+/**
+ * Compare a word of a given length with a string, like strcmp.
+ */
+int dict_packed_compare(const char* word, int length, const char* other) {
+  for (int i = 0; i < length; i++) {
+    if (other[i] == '\0') return 1;
+    if (word[i] != other[i]) return (unsigned char) word[i] - (unsigned char) other[i];
+  }
+  return (other[length] == '\0') ? 0 : -1;
+}
+
+/**
+ * Check whether a string is a word, the start of a word or neither,
+ * by a binary search over the first words of the blocks and a scan of one block.
+ * A string is the start of a word when the first word after it starts with it.
+ */
+int dict_packed_lookup(const DictionaryPacked* packed, const char* word) {
+  if (packed->blocks == 0) return DICT_NONE;
+  uint32_t lo = 0;
+  uint32_t hi = packed->blocks;
+  while (hi - lo > 1) {
+    uint32_t mid = lo + (hi - lo) / 2;
+    const uint8_t* head = &packed->data[packed->offsets[mid]];
+    if (dict_packed_compare((const char*) head + 1, head[0], word) <= 0) {
+      lo = mid;
+    } else {
+      hi = mid;
+    }
+  }
+
+  char current[DICT_MAX_WORD_LENGTH];
+  int length, shared;
+  int word_length = strlen(word);
+  const uint8_t* p = &packed->data[packed->offsets[lo]];
+  const uint8_t* end = packed->data + ((lo + 1 < packed->blocks) ? packed->offsets[lo + 1] : packed->size);
+  for (int first = 1; p < end; first = 0) {
+    p = dict_packed_next(p, first, current, &length, &shared);
+    int cmp = dict_packed_compare(current, length, word);
+    if (cmp == 0) return DICT_WORD;
+    if (cmp > 0) {
+      return (word_length <= length && memcmp(current, word, word_length) == 0) ? DICT_PREFIX : DICT_NONE;
+    }
+  }
+  // All words of the block come before the string, the first word after it
+  // is the first word of the next block.
+  if (lo + 1 == packed->blocks) return DICT_NONE;
+  const uint8_t* head = &packed->data[packed->offsets[lo + 1]];
+  return (word_length <= head[0] && memcmp(head + 1, word, word_length) == 0) ? DICT_PREFIX : DICT_NONE;
+}
+
+// Datastructure for collecting the words passing a filter.
+typedef struct DictionaryWords DictionaryWords;
+struct DictionaryWords {
+  char* buffer;
+  size_t length;
+  size_t capacity;
+  size_t* offsets;
+  uint32_t* languages;
+  int count;
+  int offsets_capacity;
+};
+
+void dict_words_init(DictionaryWords* out) {
+  out->capacity = 4096;
+  out->length = 0;
+  out->buffer = malloc(out->capacity);
+  out->offsets_capacity = 1024;
+  out->count = 0;
+  out->offsets = malloc(out->offsets_capacity * sizeof(size_t));
+  out->languages = malloc(out->offsets_capacity * sizeof(uint32_t));
+}
+
+void dict_words_add(DictionaryWords* out, const char* word, int length, uint32_t languages) {
+  if (out->length + length + 1 > out->capacity) {
+    while (out->length + length + 1 > out->capacity) out->capacity *= 2;
+    out->buffer = realloc(out->buffer, out->capacity);
+  }
+  if (out->count == out->offsets_capacity) {
+    out->offsets_capacity *= 2;
+    out->offsets = realloc(out->offsets, out->offsets_capacity * sizeof(size_t));
+    out->languages = realloc(out->languages, out->offsets_capacity * sizeof(uint32_t));
+  }
+  out->languages[out->count] = languages;
+  memcpy(&out->buffer[out->length], word, length);
+  out->buffer[out->length + length] = '\0';
+  out->offsets[out->count++] = out->length;
+  out->length += length + 1;
+}
+
+/**
+ * Build a trie, or a packed dictionary, from the collected words.
+ */
+Dictionary* dict_words_finish(DictionaryWords* out, uint32_t languages, int packed) {
+  char** words = malloc((out->count > 0 ? out->count : 1) * sizeof(char*));
+  for (int i = 0; i < out->count; i++) {
+    words[i] = &out->buffer[out->offsets[i]];
+  }
+  Dictionary* dict;
+  if (packed) {
+    dict = dict_create_packed(words, (languages > 1) ? out->languages : NULL, out->count);
+  } else {
+    dict = dict_create_sorted(words, out->languages, out->count, 1);
+  }
+  dict->languages = languages;
+  free(words);
+  free(out->languages);
+  free(out->offsets);
+  free(out->buffer);
+  return dict;
+}
+
+/**
+ * Collect the words below a node that pass a filter, in sorted order.
+ * A whole subtree is skipped as soon as its prefix uses a letter more often
+ * than available, or a pair of letters that cannot follow each other.
+ */
+void dict_filter_node(const Dictionary* dict, const DictionaryFilter* filter, uint32_t node,
+    char* word, int depth, uint8_t* used, DictionaryWords* out) {
+  const DictionaryNode* n = &dict->nodes[node];
+  if (n->children & DICT_TERMINAL) {
+    dict_words_add(out, word, depth, n->languages);
+  }
+  if (depth >= DICT_MAX_WORD_LENGTH) return;
+
+  uint32_t letters = n->children & ~DICT_TERMINAL;
+  if (depth > 0) letters &= filter->bigrams[word[depth - 1] - 'a'];
+  uint32_t child = n->first;
+  for (int letter = 0; letter < DICT_LETTERS; letter++) {
+    uint32_t bit = 1u << letter;
+    if (!(n->children & bit)) continue;
+    if ((letters & bit) && used[letter] < filter->counts[letter]) {
+      used[letter]++;
+      word[depth] = 'a' + letter;
+      dict_filter_node(dict, filter, child, word, depth + 1, used, out);
+      used[letter]--;
+    }
+    child++;
+  }
+}
+
+/**
+ * Check whether a word uses no letter more often than available, comparing
+ * eight counts at a time: a byte of (available | 0x80) - used keeps its high
+ * bit exactly when the letter is available often enough.
+ */
+static inline int dict_counts_fit(const uint8_t* counts, const uint8_t* used) {
+  const uint64_t high = 0x8080808080808080ull;
+  uint64_t missing = 0;
+  for (int i = 0; i < DICT_COUNT_BYTES; i += 8) {
+    uint64_t available, needed;
+    memcpy(&available, &counts[i], sizeof(uint64_t));
+    memcpy(&needed, &used[i], sizeof(uint64_t));
+    missing |= ~((available | high) - needed) & high;
+  }
+  return missing == 0;
+}
+
+/**
+ * Collect the words of a packed dictionary that pass a filter.
+ * When a word fails at some letter, the following words sharing the prefix
+ * up to that letter fail as well and are skipped without checking them.
+ * The pairs are checked letter by letter, the counts all at once afterwards.
+ */
+void dict_filter_packed(const DictionaryPacked* packed, const DictionaryFilter* filter, DictionaryWords* out) {
+  char word[DICT_MAX_WORD_LENGTH];
+  int length, shared;
+  uint32_t index = 0;
+  for (uint32_t block = 0; block < packed->blocks; block++) {
+    const uint8_t* p = &packed->data[packed->offsets[block]];
+    const uint8_t* end = packed->data + ((block + 1 < packed->blocks) ? packed->offsets[block + 1] : packed->size);
+    int fail = DICT_MAX_WORD_LENGTH;
+    for (int first = 1; p < end; first = 0, index++) {
+      p = dict_packed_next(p, first, word, &length, &shared);
+      if (shared > fail) continue;
+      uint8_t used[DICT_COUNT_BYTES];
+      memset(used, 0, sizeof(used));
+      fail = DICT_MAX_WORD_LENGTH;
+      int checked = 0;
+      for (; checked < length; checked++) {
+        int letter = word[checked] - 'a';
+        if (letter < 0 || letter >= DICT_LETTERS
+            || (checked > 0 && !(filter->bigrams[word[checked - 1] - 'a'] & (1u << letter)))) {
+          fail = checked;
+          break;
+        }
+        used[letter]++;
+      }
+      if (!dict_counts_fit(filter->counts, used)) {
+        // Find the letter that is used once too often, to skip its prefix.
+        memset(used, 0, sizeof(used));
+        for (int i = 0; i < checked; i++) {
+          int letter = word[i] - 'a';
+          if (++used[letter] > filter->counts[letter]) {
+            fail = i;
+            break;
+          }
+        }
+      }
+      if (fail == DICT_MAX_WORD_LENGTH) {
+        dict_words_add(out, word, length, (packed->languages != NULL) ? packed->languages[index] : 1);
+      }
+    }
+  }
+}
+
+/**
+ * Collect the words of a trie or packed dictionary that pass a filter, in sorted order.
+ */
+void dict_collect(const Dictionary* dict, const DictionaryFilter* filter, DictionaryWords* out) {
+  dict_words_init(out);
+  if (dict->packed != NULL) {
+    dict_filter_packed(dict->packed, filter, out);
+  } else {
+    char word[DICT_MAX_WORD_LENGTH];
+    uint8_t used[DICT_LETTERS];
+    memset(used, 0, sizeof(used));
+    dict_filter_node(dict, filter, DICT_ROOT, word, 0, used, out);
+  }
+}
+
+/**
+ * Build a smaller dictionary containing only the words that pass a filter.
+ */
+Dictionary* dict_filter(const Dictionary* dict, const DictionaryFilter* filter) {
+  DictionaryWords out;
+  dict_collect(dict, filter, &out);
+  return dict_words_finish(&out, dict->languages, 0);
+}
+
+/**
+ * Build a packed copy of a dictionary.
+ */
+Dictionary* dict_pack(const Dictionary* dict) {
+  DictionaryFilter all;
+  memset(all.counts, DICT_MAX_WORD_LENGTH, sizeof(all.counts));
+  for (int letter = 0; letter < DICT_LETTERS; letter++) {
+    all.bigrams[letter] = (1u << DICT_LETTERS) - 1;
+  }
+  DictionaryWords out;
+  dict_collect(dict, &all, &out);
+  return dict_words_finish(&out, dict->languages, 1);
+}
+
+/**
+ * Stack an allow list and a deny list into one overlay dictionary,
+ * in which the words of each list belong to their own language.
+ * Either list can be NULL. The lists are not destroyed.
+ */
+Dictionary* dict_overlay_create(Dictionary* allow, Dictionary* deny) {
+  Dictionary* empty = dict_create(NULL, 0);
+  Dictionary* layers[2];
+  layers[DICT_OVERLAY_ALLOW] = (allow != NULL) ? allow : empty;
+  layers[DICT_OVERLAY_DENY] = (deny != NULL) ? deny : empty;
+  Dictionary* overlay = dict_merge(layers, 2);
+  dict_destroy(empty);
+  return overlay;
+}
+
+/**
+ * Build a smaller dictionary containing only the words that pass a filter,
+ * looking through an overlay on top of the dictionary: words on its deny list
+ * are left out, words on its allow list are added for every language.
+ * A word on both lists is denied. The overlay can be NULL.
+ */
+Dictionary* dict_filter_overlay(const Dictionary* dict, const Dictionary* overlay, const DictionaryFilter* filter) {
+  if (overlay == NULL || overlay->words == 0) return dict_filter(dict, filter);
+  DictionaryWords base, layers, out;
+  dict_collect(dict, filter, &base);
+  dict_collect(overlay, filter, &layers);
+  dict_words_init(&out);
+
+  uint32_t all = (dict->languages >= DICT_MAX_LANGUAGES) ? UINT32_MAX : (1u << dict->languages) - 1;
+  uint32_t allow = 1u << DICT_OVERLAY_ALLOW;
+  uint32_t deny = 1u << DICT_OVERLAY_DENY;
+  int i = 0;
+  int j = 0;
+  while (i < base.count || j < layers.count) {
+    const char* word = NULL;
+    uint32_t languages = 0;
+    int cmp = (i == base.count) ? 1 : (j == layers.count) ? -1
+      : strcmp(&base.buffer[base.offsets[i]], &layers.buffer[layers.offsets[j]]);
+    if (cmp <= 0) {
+      word = &base.buffer[base.offsets[i]];
+      languages = base.languages[i++];
+    }
+    if (cmp >= 0) {
+      word = &layers.buffer[layers.offsets[j]];
+      uint32_t layer = layers.languages[j++];
+      if (layer & deny) continue;
+      if (layer & allow) languages = all;
+    }
+    dict_words_add(&out, word, strlen(word), languages);
+  }
+
+  free(base.languages);
+  free(base.offsets);
+  free(base.buffer);
+  free(layers.languages);
+  free(layers.offsets);
+  free(layers.buffer);
+  return dict_words_finish(&out, dict->languages, 0);
+}
+
+DictionaryMarks* dict_marks_create(const Dictionary* dict) {
+  DictionaryMarks* marks = malloc(sizeof(DictionaryMarks));
+  marks->size = dict->size;
+  marks->bits = calloc(dict->size / 64 + 1, sizeof(uint64_t));
+  return marks;
+}
+
+void dict_marks_destroy(DictionaryMarks* marks) {
+  free(marks->bits);
+  free(marks);
+}
+
+/**
+ * Mark a node, without locking. Returns 1 for the one call that marks it
+ * first, 0 if it was marked already.
+ */
+int dict_mark(DictionaryMarks* marks, uint32_t node) {
+  if (node >= marks->size) return 0;
+  uint64_t bit = (uint64_t) 1 << (node % 64);
+  uint64_t* word = &marks->bits[node / 64];
+  if (__atomic_load_n(word, __ATOMIC_RELAXED) & bit) return 0;
+  return !(__atomic_fetch_or(word, bit, __ATOMIC_RELAXED) & bit);
+}
+
+DictionarySnapshot* dict_snapshot_create(Dictionary* dict) {
+  DictionarySnapshot* snapshot = malloc(sizeof(DictionarySnapshot));
+  snapshot->dict = dict;
+  // The reference held by the store.
+  snapshot->references = 1;
+  return snapshot;
+}
+
+DictionaryStore* dict_store_create(Dictionary* dict) {
+  DictionaryStore* store = malloc(sizeof(DictionaryStore));
+  store->current = dict_snapshot_create(dict);
+  store->acquiring = 0;
+  return store;
+}
+
+/**
+ * Destroy a store. Snapshots still acquired stay valid until released.
+ */
+void dict_store_destroy(DictionaryStore* store) {
+  dict_store_release(store->current);
+  free(store);
+}
+
+/**
+ * Get the current version of the dictionary, which stays valid until released,
+ * even when a new version is published in the meantime.
+ */
+DictionarySnapshot* dict_store_acquire(DictionaryStore* store) {
+  // Announce the reader, so a publisher cannot drop the snapshot
+  // between loading the pointer and taking a reference to it.
+  __atomic_add_fetch(&store->acquiring, 1, __ATOMIC_SEQ_CST);
+  DictionarySnapshot* snapshot = __atomic_load_n(&store->current, __ATOMIC_SEQ_CST);
+  __atomic_add_fetch(&snapshot->references, 1, __ATOMIC_SEQ_CST);
+  __atomic_sub_fetch(&store->acquiring, 1, __ATOMIC_SEQ_CST);
+  return snapshot;
+}
+
+void dict_store_release(DictionarySnapshot* snapshot) {
+  if (__atomic_sub_fetch(&snapshot->references, 1, __ATOMIC_SEQ_CST) == 0) {
+    dict_destroy(snapshot->dict);
+    free(snapshot);
+  }
+}
+
+/**
+ * Replace the current version of the dictionary. The old version is freed
+ * as soon as all readers that acquired it have released it.
+ */
+void dict_store_publish(DictionaryStore* store, Dictionary* dict) {
+  DictionarySnapshot* snapshot = dict_snapshot_create(dict);
+  DictionarySnapshot* old = __atomic_exchange_n(&store->current, snapshot, __ATOMIC_SEQ_CST);
+  // Wait for readers that may have loaded the old pointer without a reference yet.
+  while (__atomic_load_n(&store->acquiring, __ATOMIC_SEQ_CST) > 0) {
+    sched_yield();
+  }
+  dict_store_release(old);
+}
+
+// Datastructure for a pending node while merging dictionaries:
+// the node in the merged dictionary and the same node in every input.
+typedef struct DictionaryMergeFrame DictionaryMergeFrame;
+struct DictionaryMergeFrame {
+  uint32_t node;
+  uint32_t inputs[DICT_MAX_LANGUAGES];
+};
+
+/**
+ * Merge dictionaries of different languages into one, in which the words
+ * of the i-th dictionary belong to language i. Every prefix is stored once,
+ * so one traversal of the merged dictionary serves all languages.
+ * Packed dictionaries have to be filtered into tries first.
+ */
+Dictionary* dict_merge(Dictionary** dicts, int count) {
+  if (count > DICT_MAX_LANGUAGES) count = DICT_MAX_LANGUAGES;
+  uint32_t capacity;
+  Dictionary* dict = dict_alloc(&capacity);
+  dict->languages = count;
+  dict_alloc_nodes(dict, &capacity, 1);
+
+  int stack_capacity = 64;
+  int stack_size = 0;
+  DictionaryMergeFrame* stack = malloc(stack_capacity * sizeof(DictionaryMergeFrame));
+  stack[stack_size].node = DICT_ROOT;
+  for (int i = 0; i < count; i++) {
+    stack[stack_size].inputs[i] = DICT_ROOT;
+  }
+  stack_size++;
+
+  while (stack_size > 0) {
+    DictionaryMergeFrame frame = stack[--stack_size];
+    uint32_t letters = 0;
+    uint32_t languages = 0;
+    for (int i = 0; i < count; i++) {
+      if (frame.inputs[i] == DICT_NO_NODE) continue;
+      DictionaryNode* input = &dicts[i]->nodes[frame.inputs[i]];
+      letters |= input->children & ~DICT_TERMINAL;
+      if (input->children & DICT_TERMINAL) languages |= (1u << i);
+    }
+    if (languages != 0) {
+      dict->nodes[frame.node].children |= DICT_TERMINAL;
+      dict->nodes[frame.node].languages = languages;
+      dict->words++;
+    }
+    if (letters == 0) continue;
+
+    uint32_t first = dict_alloc_nodes(dict, &capacity, __builtin_popcount(letters));
+    dict->nodes[frame.node].children |= letters;
+    dict->nodes[frame.node].first = first;
+
+    for (int letter = DICT_LETTERS - 1; letter >= 0; letter--) {
+      if (!(letters & (1u << letter))) continue;
+      if (stack_size == stack_capacity) {
+        stack_capacity *= 2;
+        stack = realloc(stack, stack_capacity * sizeof(DictionaryMergeFrame));
+      }
+      DictionaryMergeFrame* child = &stack[stack_size++];
+      child->node = first + __builtin_popcount(letters & ((1u << letter) - 1));
+      for (int i = 0; i < count; i++) {
+        child->inputs[i] = dict_child(dicts[i], frame.inputs[i], 'a' + letter);
+      }
+    }
+  }
+
+  free(stack);
+  dict->nodes = realloc(dict->nodes, dict->size * sizeof(DictionaryNode));
+  return dict;
+}
+
+/**
+ * Write a dictionary to a binary image that can be loaded with dict_load.
+ * Returns 0 on success.
+ */
+int dict_save(const Dictionary* dict, const char file_name[]) {
+  FILE* fp = fopen(file_name, "wb");
+  if (fp == NULL) return -1;
+  DictionaryHeader header;
+  memcpy(header.magic, DICT_IMAGE_MAGIC, sizeof(header.magic));
+  header.version = DICT_IMAGE_VERSION;
+  header.size = dict->size;
+  header.words = dict->words;
+  header.languages = dict->languages;
+  int ok = fwrite(&header, sizeof(header), 1, fp) == 1
+    && fwrite(dict->nodes, sizeof(DictionaryNode), dict->size, fp) == dict->size;
+  return (fclose(fp) == 0 && ok) ? 0 : -1;
+}
+
+/**
+ * Check that every edge of the nodes of an image stays within the image,
+ * so a truncated or corrupt file is never followed out of bounds.
+ */
+int dict_nodes_valid(const DictionaryNode* nodes, uint32_t size) {
+  const uint32_t letters = (1u << DICT_LETTERS) - 1;
+  for (uint32_t i = 0; i < size; i++) {
+    uint32_t children = nodes[i].children & ~DICT_TERMINAL;
+    if (children & ~letters) return 0;
+    if (children != 0 && (uint64_t) nodes[i].first + __builtin_popcount(children) > size) return 0;
+  }
+  return 1;
+}
+
+/**
+ * Map a binary dictionary image into memory, read only.
+ * The nodes are used in place, so nothing is parsed or copied.
+ * Returns NULL if the file cannot be read or is not a dictionary image.
+ */
+Dictionary* dict_load(const char file_name[]) {
+  int fd = open(file_name, O_RDONLY);
+  if (fd < 0) return NULL;
+  struct stat st;
+  if (fstat(fd, &st) != 0 || st.st_size < (off_t) sizeof(DictionaryHeader)) {
+    close(fd);
+    return NULL;
+  }
+  void* image = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (image == MAP_FAILED) return NULL;
+
+  DictionaryHeader* header = (DictionaryHeader*) image;
+  if (memcmp(header->magic, DICT_IMAGE_MAGIC, sizeof(header->magic)) != 0
+      || header->version != DICT_IMAGE_VERSION || header->size == 0
+      || (size_t) st.st_size < sizeof(DictionaryHeader) + (size_t) header->size * sizeof(DictionaryNode)
+      || !dict_nodes_valid((DictionaryNode*) (header + 1), header->size)) {
+    munmap(image, st.st_size);
+    return NULL;
+  }
+
+  Dictionary* dict = malloc(sizeof(Dictionary));
+  dict->size = header->size;
+  dict->words = header->words;
+  dict->languages = header->languages;
+  dict->nodes = (DictionaryNode*) (header + 1);
+  dict->image = image;
+  dict->image_size = st.st_size;
+  dict->packed = NULL;
+  return dict;
+}
+
+/**
+ * Get the index of a letter in the alphabet, or -1 if it is not a letter.
+ */
+int dict_letter(char c) {
+  int letter = tolower((unsigned char) c) - 'a';
+  if (letter < 0 || letter >= DICT_LETTERS) return -1;
+  return letter;
+}
+
+/**
+ * Follow the edge for a character from a node, in constant time.
+ */
+uint32_t dict_child(const Dictionary* dict, uint32_t node, char c) {
+  int letter = dict_letter(c);
+  if (node == DICT_NO_NODE || letter < 0) return DICT_NO_NODE;
+  const DictionaryNode* n = &dict->nodes[node];
+  uint32_t bit = 1u << letter;
+  if (!(n->children & bit)) return DICT_NO_NODE;
+  return n->first + __builtin_popcount(n->children & (bit - 1));
+}
+
+/**
+ * Find the node for a word or prefix.
+ */
+uint32_t dict_find(const Dictionary* dict, const char* word) {
+  uint32_t node = DICT_ROOT;
+  while (*word != '\0' && node != DICT_NO_NODE) {
+    node = dict_child(dict, node, *word);
+    word++;
+  }
+  return node;
+}
+
+/**
+ * Get the bitmask of the languages in which a node ends a word.
+ */
+uint32_t dict_node_languages(const Dictionary* dict, uint32_t node) {
+  if (node == DICT_NO_NODE) return 0;
+  return dict->nodes[node].languages;
+}
+
+int dict_node_status(const Dictionary* dict, uint32_t node) {
+  if (node == DICT_NO_NODE) return DICT_NONE;
+  if (dict->nodes[node].children & DICT_TERMINAL) return DICT_WORD;
+  return DICT_PREFIX;
+}
+
+/**
+ * Check whether a string is a word, the start of a word or neither.
+ */
+int dict_lookup(const Dictionary* dict, const char* word) {
+  if (dict->packed != NULL) return dict_packed_lookup(dict->packed, word);
+  return dict_node_status(dict, dict_find(dict, word));
+}
+
+/**
+ * Compare two words. Used by the merge sort algorithm.
+ */
+int dict_compare_words(void* data1, void* data2) {
+  return strcmp((char*) data1, (char*) data2) > 0;
+}
@@ -0,0 +1,168 @@
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <stdio.h>
+
+#ifndef DICTIONARY
+#define DICTIONARY
+
+// Results of a dictionary lookup.
+#define DICT_NONE 0
+#define DICT_PREFIX 1
+#define DICT_WORD 2
+
+// Node indices with a special meaning.
+#define DICT_ROOT 0
+#define DICT_NO_NODE UINT32_MAX
+
+// Number of letters in the alphabet, and the flag marking the end of a word.
+#define DICT_LETTERS 26
+#define DICT_TERMINAL (1u << 31)
+
+// Maximum length of a word in a dictionary.
+#define DICT_MAX_WORD_LENGTH 64
+
+// Letter counts of a filter, padded to whole 64-bit words so they are
+// compared eight at a time. Every count stays below 128.
+#define DICT_COUNT_BYTES 32
+#define DICT_MAX_COUNT 127
+
+// Maximum number of languages merged into one dictionary.
+#define DICT_MAX_LANGUAGES 32
+
+// Languages of the allow and deny lists in an overlay dictionary.
+#define DICT_OVERLAY_ALLOW 0
+#define DICT_OVERLAY_DENY 1
+
+// Number of words in a block of a front coded dictionary.
+#define DICT_BLOCK_WORDS 16
+
+// Identification of a precompiled dictionary image.
+#define DICT_IMAGE_MAGIC "WDCT"
+#define DICT_IMAGE_VERSION 2
+
+// Datastructure for a node in a flattened trie.
+// Bit i of children is set when the node has a child for letter 'a' + i,
+// the children themselves are stored contiguously starting at first.
+// Bit i of languages is set when the node ends a word in language i.
+typedef struct DictionaryNode DictionaryNode;
+struct DictionaryNode {
+  uint32_t children;
+  uint32_t first;
+  uint32_t languages;
+};
+
+// Datastructure for the sorted words of a dictionary stored front coded.
+// The words are grouped in blocks of DICT_BLOCK_WORDS. The first word of a
+// block is stored as its length and its letters, every other word as the
+// number of letters it shares with the previous word, the number of letters
+// following those and these letters. The offsets of the blocks in the data
+// form a sparse index, which is searched by the first word of every block.
+typedef struct DictionaryPacked DictionaryPacked;
+struct DictionaryPacked {
+  uint32_t blocks;
+  uint32_t* offsets;
+  uint8_t* data;
+  size_t size;
+  uint32_t* languages;
+};
+
+// Datastructure for a dictionary: a trie stored as one flat array of nodes.
+// A dictionary is never modified after dict_create, so any number of threads
+// can read it at the same time without locking.
+// A packed dictionary has no nodes, only front coded words: it takes a
+// fraction of the memory and is filtered into a trie before searching it.
+typedef struct Dictionary Dictionary;
+struct Dictionary {
+  uint32_t size;
+  uint32_t words;
+  uint32_t languages;
+  DictionaryNode* nodes;
+  void* image;
+  size_t image_size;
+  DictionaryPacked* packed;
+};
+
+// Datastructure describing which words can possibly be formed,
+// by the number of times every letter is available and by the letters
+// that can follow each letter (bit j of bigrams[i]: letter j after letter i).
+typedef struct DictionaryFilter DictionaryFilter;
+struct DictionaryFilter {
+  uint8_t counts[DICT_COUNT_BYTES];
+  uint32_t bigrams[DICT_LETTERS];
+};
+
+// Datastructure for a set of nodes of a dictionary, one bit per node.
+// Nodes are marked atomically, so any number of threads can share it.
+typedef struct DictionaryMarks DictionaryMarks;
+struct DictionaryMarks {
+  uint32_t size;
+  uint64_t* bits;
+};
+
+// Datastructure for one published version of a dictionary,
+// freed when the last solve holding a reference to it releases it.
+typedef struct DictionarySnapshot DictionarySnapshot;
+struct DictionarySnapshot {
+  Dictionary* dict;
+  int references;
+};
+
+// Datastructure through which a dictionary can be replaced while it is used.
+// A new version is published with an atomic pointer swap, readers that are
+// still using the old version keep it alive until they release it.
+typedef struct DictionaryStore DictionaryStore;
+struct DictionaryStore {
+  DictionarySnapshot* current;
+  int acquiring;
+};
+
+// Header of a precompiled dictionary image, followed by the nodes.
+// Nodes refer to each other by index, so the image can be mapped anywhere.
+typedef struct DictionaryHeader DictionaryHeader;
+struct DictionaryHeader {
+  char magic[4];
+  uint32_t version;
+  uint32_t size;
+  uint32_t words;
+  uint32_t languages;
+};
+
+Dictionary* dict_create(char** words, int count);
+Dictionary* dict_create_parallel(char** words, int count, int tc);
+Dictionary* dict_create_sorted(char** words, uint32_t* languages, int count, int tc);
+Dictionary* dict_merge(Dictionary** dicts, int count);
+Dictionary* dict_create_packed(char** words, uint32_t* languages, int count);
+Dictionary* dict_pack(const Dictionary* dict);
+size_t dict_memory_size(const Dictionary* dict);
+int dict_words_sorted(char** words, int count);
+void dict_destroy(Dictionary* dict);
+
+Dictionary* dict_filter(const Dictionary* dict, const DictionaryFilter* filter);
+Dictionary* dict_overlay_create(Dictionary* allow, Dictionary* deny);
+Dictionary* dict_filter_overlay(const Dictionary* dict, const Dictionary* overlay, const DictionaryFilter* filter);
+
+DictionaryMarks* dict_marks_create(const Dictionary* dict);
+void dict_marks_destroy(DictionaryMarks* marks);
+int dict_mark(DictionaryMarks* marks, uint32_t node);
+
+DictionaryStore* dict_store_create(Dictionary* dict);
+void dict_store_destroy(DictionaryStore* store);
+DictionarySnapshot* dict_store_acquire(DictionaryStore* store);
+void dict_store_release(DictionarySnapshot* snapshot);
+void dict_store_publish(DictionaryStore* store, Dictionary* dict);
+
+int dict_save(const Dictionary* dict, const char file_name[]);
+Dictionary* dict_load(const char file_name[]);
+
+int dict_letter(char c);
+uint32_t dict_child(const Dictionary* dict, uint32_t node, char c);
+uint32_t dict_find(const Dictionary* dict, const char* word);
+int dict_node_status(const Dictionary* dict, uint32_t node);
+uint32_t dict_node_languages(const Dictionary* dict, uint32_t node);
+int dict_lookup(const Dictionary* dict, const char* word);
+
+int dict_compare_words(void* data1, void* data2);
+
+#endif
@@ -1,18 +1,66 @@
 #include "hash.h"
 
+// Multipliers with well spread bits, from the golden ratio and MurmurHash3.
+#define HASH_GOLDEN 0x9e3779b97f4a7c15ULL
+#define HASH_MIX 0xff51afd7ed558ccdULL
+
 unsigned int hash_polynomial(const char* key) {
   int n = strlen(key);
   uintmax_t hash_code = polynomial(n-1, 31, key, n);
   return (unsigned int) hash_code;
 }
 
-// Horner's rule for polynomial evaluation
+// Horner's rule for polynomial evaluation, from the last coefficient down.
 uintmax_t polynomial(unsigned int p, const unsigned int z, const char* av, unsigned int n) {
-  int idx = n - 1;
-  if (p == 0) {
-    return (uintmax_t) av[idx];
+  if (n == 0) return 0;
+  uintmax_t result = (uintmax_t) av[n - 1];
+  for (int idx = n - 2; idx >= (int) (n - 1 - p); idx--) {
+    result = (uintmax_t) av[idx] + z * result;
+  }
+  return result;
+}
+
+// FNV-1a: one xor and one multiplication per character.
+unsigned int hash_fnv1a(const char* key) {
+  uint32_t hash_code = 2166136261u;
+  for (; *key != '\0'; key++) {
+    hash_code ^= (unsigned char) *key;
+    hash_code *= 16777619u;
+  }
+  return hash_code;
+}
+
+uint64_t hash_finish(uint64_t hash_code) {
+  hash_code ^= hash_code >> 33;
+  hash_code *= HASH_MIX;
+  hash_code ^= hash_code >> 33;
+  return hash_code;
+}
+
+// Hashes eight characters at a time.
+unsigned int hash_words(const char* key) {
+  size_t length = strlen(key);
+  uint64_t hash_code = length * HASH_GOLDEN;
+  while (length >= sizeof(uint64_t)) {
+    uint64_t word;
+    memcpy(&word, key, sizeof(word));
+    hash_code = (hash_code ^ word) * HASH_GOLDEN;
+    hash_code ^= hash_code >> 32;
+    key += sizeof(word);
+    length -= sizeof(word);
+  }
+  uint64_t rest = 0;
+  memcpy(&rest, key, length);
+  return (unsigned int) hash_finish(hash_code ^ rest);
+}
+
+// Hashes keys of up to eight characters, like prefixes, with a single
+// multiplication, without first measuring their length.
+unsigned int hash_short(const char* key) {
+  uint64_t word = 0;
+  for (int i = 0; i < (int) sizeof(word); i++) {
+    if (key[i] == '\0') return (unsigned int) ((word * HASH_GOLDEN) >> 32);
+    word |= (uint64_t) (unsigned char) key[i] << (8 * i);
   }
-  idx -= p;
-  uintmax_t a = (uintmax_t) av[idx];
-  return a + (z * polynomial(p - 1, z, av, n));
+  return hash_words(key);
 }
@@ -3,5 +3,13 @@
 #include <ctype.h>
 #include <string.h>
 
+#ifndef HASH
+#define HASH
+
 unsigned int hash_polynomial(const char* key);
 uintmax_t polynomial(unsigned int p, unsigned int z, const char* av, unsigned int n);
+unsigned int hash_fnv1a(const char* key);
+unsigned int hash_words(const char* key);
+unsigned int hash_short(const char* key);
+
+#endif
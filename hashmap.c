@@ -1,33 +1,112 @@
 #include "hashmap.h"
+#include "hash.h"
+
+// Maximum load of the table, in percent, before it grows.
+#define HASHMAP_MAX_LOAD 75
+#define HASHMAP_MIN_SIZE 8
+#define HASHMAP_ARENA_BLOCK 4096
+
+// A block of memory the keys are allocated from, freed all at once.
+typedef struct HashMapArena HashMapArena;
+struct HashMapArena {
+  HashMapArena* next;
+  size_t used;
+  size_t size;
+  char data[];
+};
 
+// Open addressing with linear probing: every key is stored in the first free
+// bucket at or after its home index. The hash of every key is kept,
+// so growing the table and most failed comparisons need no string work.
 struct HashMap {
   size_t size;
+  size_t count;
+  unsigned int shift;
   HashFunction hash_function;
-  Bucket** buckets;
+  Bucket* buckets;
+  HashMapArena* arena;
 };
 
 struct Bucket {
   char* key;
   void* data;
-  Bucket* next;
+  unsigned int hash;
 };
 
+char* hm_intern_key(HashMap* hm, const char* key) {
+  size_t length = strlen(key) + 1;
+  HashMapArena* arena = hm->arena;
+  if (arena == NULL || arena->used + length > arena->size) {
+    size_t size = (length > HASHMAP_ARENA_BLOCK) ? length : HASHMAP_ARENA_BLOCK;
+    arena = malloc(sizeof(HashMapArena) + size);
+    arena->next = hm->arena;
+    arena->used = 0;
+    arena->size = size;
+    hm->arena = arena;
+  }
+  char* interned = &arena->data[arena->used];
+  memcpy(interned, key, length);
+  arena->used += length;
+  return interned;
+}
+
+// Spread the bits of a hash over the table with Fibonacci hashing,
+// since a weak hash function like the sum of the characters
+// would otherwise put most keys in a few long runs.
+size_t hm_home_index(HashMap* hm, unsigned int hash) {
+  return (size_t) ((hash * 2654435769u) >> hm->shift);
+}
+
+void hm_allocate(HashMap* hm, size_t size) {
+  hm->size = size;
+  hm->shift = 32;
+  while (size > 1) {
+    size >>= 1;
+    hm->shift--;
+  }
+  hm->buckets = calloc(hm->size, sizeof(Bucket));
+}
+
+// Move all buckets into a new table, without hashing any key again.
+void hm_rebuild(HashMap* hm, size_t size) {
+  Bucket* old = hm->buckets;
+  size_t old_size = hm->size;
+  hm_allocate(hm, size);
+  for (size_t i = 0; i < old_size; i++) {
+    if (old[i].key == NULL) continue;
+    size_t index = hm_home_index(hm, old[i].hash);
+    while (hm->buckets[index].key != NULL) {
+      index = (index + 1) & (hm->size - 1);
+    }
+    hm->buckets[index] = old[i];
+  }
+  free(old);
+}
+
+// Find the bucket of a key with a known hash, or NULL if it is absent.
+Bucket* hm_find(HashMap* hm, const char* key, unsigned int key_hash) {
+  size_t index = hm_home_index(hm, key_hash);
+  while (hm->buckets[index].key != NULL) {
+    Bucket* bucket = &hm->buckets[index];
+    if (bucket->hash == key_hash && strcmp(bucket->key, key) == 0) {
+      return bucket;
+    }
+    index = (index + 1) & (hm->size - 1);
+  }
+  return NULL;
+}
+
 HashMap* create_hashmap(size_t key_space) {
   HashMap* hm = malloc(sizeof(HashMap));
-  hm->size = key_space;
-  hm->hash_function = hash;
-  hm->buckets = calloc(key_space, sizeof(Bucket*));
+  size_t size = HASHMAP_MIN_SIZE;
+  while (size < key_space) size *= 2;
+  hm_allocate(hm, size);
+  hm->count = 0;
+  hm->hash_function = hash_short;
+  hm->arena = NULL;
   return hm;
 }
 
-Bucket* create_bucket(const char* key, void* data, Bucket* next) {
-  Bucket* bucket = malloc(sizeof(Bucket));
-  bucket->key = strdup(key);
-  bucket->data = data;
-  bucket->next = next;
-  return bucket;
-}
-
 unsigned int hash(const char* key) {
   int length = strlen(key);
   int sum = 0;
@@ -38,10 +117,11 @@ unsigned int hash(const char* key) {
 }
 
 void insert_data(HashMap* hm, const char* key, void* data, ResolveCollisionCallback resolve_collision) {
-  Bucket* bucket = get_bucket(hm, key);
+  unsigned int key_hash = hm->hash_function(key);
+  Bucket* bucket = hm_find(hm, key, key_hash);
   if (bucket == NULL) {
-    Bucket* new_bucket = create_bucket(key, data, NULL);
-    add_bucket(hm, new_bucket);
+    Bucket new_bucket = {hm_intern_key(hm, key), data, key_hash};
+    add_bucket(hm, &new_bucket);
   } else if (resolve_collision != NULL) {
     bucket->data = resolve_collision(bucket->data, data);
   }
@@ -56,12 +136,10 @@ void* get_data(HashMap* hm, const char* key) {
 }
 
 void iterate(HashMap* hm, void (*callback)(const char* key, void* data)) {
-  for (unsigned int i = 0; i < hm->size; i++) {
-    Bucket* bucket = hm->buckets[i];
-
-    while (bucket != NULL) {
+  for (size_t i = 0; i < hm->size; i++) {
+    Bucket* bucket = &hm->buckets[i];
+    if (bucket->key != NULL) {
       callback(bucket->key, bucket->data);
-      bucket = bucket->next;
     }
   }
 }
@@ -69,116 +147,94 @@ void iterate(HashMap* hm, void (*callback)(const char* key, void* data)) {
 void remove_data(HashMap* hm, const char* key, DestroyDataCallback destroy_data) {
   Bucket* bucket = get_bucket(hm, key);
   if (bucket != NULL) {
-    Bucket* prev = get_bucket_prev(hm, bucket);
-    Bucket* next = bucket->next;
     remove_bucket(hm, bucket, destroy_data);
-    if (prev == NULL) {
-      int index = get_bucket_index(hm, key);
-      hm->buckets[index] = next;
-    }
   }
 }
 
 void delete_hashmap(HashMap* hm, DestroyDataCallback destroy_data) {
-  for (unsigned int i = 0; i < hm->size; i++) {
-    Bucket* list = hm->buckets[i];
-    remove_buckets(hm, list, destroy_data);
+  for (size_t i = 0; i < hm->size; i++) {
+    if (hm->buckets[i].key != NULL) {
+      destroy_bucket(&hm->buckets[i], destroy_data);
+    }
+  }
+  while (hm->arena != NULL) {
+    HashMapArena* next = hm->arena->next;
+    free(hm->arena);
+    hm->arena = next;
   }
   free(hm->buckets);
   free(hm);
 }
 
 int get_bucket_index(HashMap* hm, const char* key) {
-  return hm->hash_function(key) % hm->size;
+  return hm_home_index(hm, hm->hash_function(key));
 }
 
+// Get the first bucket of the run a key is probed in, or NULL if it is empty.
 Bucket* get_bucket_list(HashMap* hm, const char* key) {
-  int index = get_bucket_index(hm, key);
-  Bucket* bucket = hm->buckets[index];
-  return bucket;
-}
-
-Bucket* get_bucket_prev(HashMap* hm, Bucket* bucket) {
-  Bucket* prev = NULL;
-  Bucket* search = get_bucket_list(hm, bucket->key);
-  while (search != bucket && search != NULL) {
-    prev = search;
-    search = search->next;
-  }
-  return prev;
+  Bucket* bucket = &hm->buckets[get_bucket_index(hm, key)];
+  return (bucket->key != NULL) ? bucket : NULL;
 }
 
+// The bucket returned stays valid until the next insertion or removal.
 Bucket* get_bucket(HashMap* hm, const char* key) {
-  Bucket* bucket = get_bucket_list(hm, key);
-  while (bucket != NULL) {
-    if (strcmp(bucket->key, key) == 0) {
-      return bucket;
-    }
-    bucket = bucket->next;
-  }
-  return NULL;
+  return hm_find(hm, key, hm->hash_function(key));
 }
 
+// Copy a bucket into the table, growing it first if it gets too full.
 void add_bucket(HashMap* hm, Bucket* bucket) {
-  Bucket* list = get_bucket_list(hm, bucket->key);
-  if (list == NULL) {
-    int index = get_bucket_index(hm, bucket->key);
-    hm->buckets[index] = bucket;
-  } else {
-    while (list->next != NULL) {
-      list = list->next;
-    }
-    list->next = bucket;
+  if ((hm->count + 1) * 100 > hm->size * HASHMAP_MAX_LOAD) {
+    hm_rebuild(hm, hm->size * 2);
+  }
+  size_t index = hm_home_index(hm, bucket->hash);
+  while (hm->buckets[index].key != NULL) {
+    index = (index + 1) & (hm->size - 1);
   }
+  hm->buckets[index] = *bucket;
+  hm->count++;
 }
 
+// Remove a bucket, moving later buckets of its run back into the gap,
+// so lookups never need markers for removed keys.
 void remove_bucket(HashMap* hm, Bucket* bucket, DestroyDataCallback destroy_data) {
-  if (bucket != NULL) {
-    Bucket* next = bucket->next;
-    Bucket* prev = get_bucket_prev(hm, bucket);
-    if (prev != NULL) {
-      prev->next = next;
+  if (bucket == NULL || bucket->key == NULL) return;
+  destroy_bucket(bucket, destroy_data);
+  size_t mask = hm->size - 1;
+  size_t gap = bucket - hm->buckets;
+  size_t index = (gap + 1) & mask;
+  while (hm->buckets[index].key != NULL) {
+    size_t home = hm_home_index(hm, hm->buckets[index].hash);
+    // Move the bucket when its home is not between the gap and itself.
+    if (((index - home) & mask) >= ((index - gap) & mask)) {
+      hm->buckets[gap] = hm->buckets[index];
+      hm->buckets[index].key = NULL;
+      gap = index;
     }
-    destroy_bucket(bucket, destroy_data);
-  }
-}
-
-void remove_buckets(HashMap* hm, Bucket* bucket, DestroyDataCallback destroy_data) {
-  if (bucket != NULL) {
-    remove_buckets(hm, bucket->next, destroy_data);
-    remove_bucket(hm, bucket, destroy_data);
+    index = (index + 1) & mask;
   }
+  hm->count--;
 }
 
+// Keys live in the arena of the hashmap, only the data is destroyed.
 void destroy_bucket(Bucket* bucket, DestroyDataCallback destroy_data) {
-  free(bucket->key);
   if (destroy_data != NULL) {
     destroy_data(bucket->data);
   }
-  free(bucket);
+  bucket->key = NULL;
+  bucket->data = NULL;
 }
 
 void set_hash_function(HashMap* hm, unsigned int (*hash_function)(const char* key)) {
   hm->hash_function = hash_function;
+  if (hm->count == 0) return;
 
-  // Rehashing: use a temporary hashmap to avoid loss of data.
-  HashMap* thm = create_hashmap(hm->size);
-  thm->hash_function = hash_function;
-  for (unsigned int i = 0; i < hm->size; i++) {
-    Bucket* bucket = hm->buckets[i];
-    while (bucket != NULL) {
-      insert_data(thm, bucket->key, bucket->data, NULL);
-      bucket = bucket->next;
+  // Rehashing: compute the new hashes in place, then move the buckets.
+  for (size_t i = 0; i < hm->size; i++) {
+    if (hm->buckets[i].key != NULL) {
+      hm->buckets[i].hash = hash_function(hm->buckets[i].key);
     }
   }
-
-  // Now remove old buckets, copy over the bucket pointers, clear the temporary hashmap and then destroy it.
-  for (unsigned int i = 0; i < hm->size; i++) {
-    remove_buckets(hm, hm->buckets[i], NULL);
-    hm->buckets[i] = thm->buckets[i];
-    thm->buckets[i] = NULL;
-  }
-  delete_hashmap(thm, NULL);
+  hm_rebuild(hm, hm->size);
 }
 
 char* strdup(const char* s) {
@@ -27,11 +27,9 @@ typedef struct Bucket Bucket;
 
 int get_bucket_index(HashMap* hm, const char* key);
 Bucket* get_bucket_list(HashMap* hm, const char* key);
-Bucket* get_bucket_prev(HashMap* hm, Bucket* bucket);
 Bucket* get_bucket(HashMap* hm, const char* key);
 void add_bucket(HashMap* hm, Bucket* bucket);
 void remove_bucket(HashMap* hm, Bucket* bucket, DestroyDataCallback destroy_data);
-void remove_buckets(HashMap* hm, Bucket* bucket, DestroyDataCallback destroy_data);
 void destroy_bucket(Bucket*, DestroyDataCallback destroy_data);
 
 // Hash Function
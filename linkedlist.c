@@ -1,28 +1,31 @@
 #include "linkedlist.h"
 
+// Freed list headers and nodes are kept for reuse by the same thread.
+PoolStats ll_pool_stats;
+__thread Pool ll_header_pool = {sizeof(LinkedListHeader), &ll_pool_stats, POOL_MAX_FREE, NULL, 0, 0, 0};
+__thread Pool ll_node_pool = {sizeof(LinkedNode), &ll_pool_stats, POOL_MAX_FREE, NULL, 0, 0, 0};
+
 /**
  * Enqueue an element to the list.
  */
 void ll_enqueue(LinkedList q, void* data) {
-  LinkedNode* node = (LinkedNode*) malloc(sizeof(LinkedNode));
+  LinkedNode* node = (LinkedNode*) pool_alloc(&ll_node_pool);
   node->data = data;
   node->next = NULL;
   if (ll_is_empty(q)) {
-    (*q) = node;
+    q->head = node;
   } else {
-    LinkedNode* qp = (*q);
-    while (qp->next != NULL) {
-      qp = qp->next;
-    }
-    qp->next = node;
+    q->tail->next = node;
   }
+  q->tail = node;
+  q->size++;
 }
 
 /**
  * Enqueue all items from a given other linked list.
  */
 void ll_enqueue_all(LinkedList q, LinkedList data) {
-  LinkedNode* node = (*data);
+  LinkedNode* node = data->head;
   while (node != NULL) {
     ll_enqueue(q, node->data);
     node = node->next;
@@ -41,10 +44,12 @@ void ll_push(LinkedList ll, void* data) {
  */
 void* ll_dequeue(LinkedList q, LLDestroyDataCallback destroy) {
   if (!ll_is_empty(q)) {
-    void* data = (*q)->data;
-    LinkedNode* tmp = (*q);
-    (*q) = (*q)->next;
-    free(tmp);
+    void* data = q->head->data;
+    LinkedNode* tmp = q->head;
+    q->head = q->head->next;
+    if (q->head == NULL) q->tail = NULL;
+    q->size--;
+    pool_free(&ll_node_pool, tmp);
     if (destroy == NULL) {
       return data;
     } else {
@@ -59,19 +64,22 @@ void* ll_dequeue(LinkedList q, LLDestroyDataCallback destroy) {
  */
 void* ll_pop(LinkedList q, LLDestroyDataCallback destroy) {
   if (!ll_is_empty(q)) {
+    // The list is singly linked, so the node before the tail is searched.
     LinkedNode* prev = NULL;
-    LinkedNode* node = (*q);
-    while (node->next != NULL) {
+    LinkedNode* node = q->head;
+    while (node != q->tail) {
       prev = node;
       node = node->next;
     }
     if (prev == NULL) {
-      (*q) = NULL;
+      q->head = NULL;
     } else {
       prev->next = NULL;
     }
+    q->tail = prev;
+    q->size--;
     void* data = node->data;
-    free(node);
+    pool_free(&ll_node_pool, node);
     if (destroy == NULL) {
       return data;
     } else {
@@ -85,7 +93,7 @@ void* ll_pop(LinkedList q, LLDestroyDataCallback destroy) {
  * Check whether a queue contains a data pointer.
  */
 int ll_contains(LinkedList q, void* pointer) {
-  LinkedNode* node = (*q);
+  LinkedNode* node = q->head;
   while (node != NULL) {
     if (pointer == node->data) {
       return 1;
@@ -99,7 +107,7 @@ int ll_contains(LinkedList q, void* pointer) {
  * Check whether a queue contains a data pointer.
  */
 int ll_contains_data(LinkedList q, void* data, LLCompareDataCallback cmp) {
-  LinkedNode* node = (*q);
+  LinkedNode* node = q->head;
   while (node != NULL) {
     if (cmp(data, node->data) == 0) {
       return 1;
@@ -113,7 +121,7 @@ int ll_contains_data(LinkedList q, void* data, LLCompareDataCallback cmp) {
  * Iterate over data in linked list in fifo order.
  */
 void ll_iterate(LinkedList ll, LLIterateCallback iterate, void* params) {
-  LinkedNode* node = (*ll);
+  LinkedNode* node = ll->head;
   int idx = 0;
   while (node != NULL) {
     iterate(idx, node->data, params);
@@ -127,11 +135,7 @@ void ll_iterate(LinkedList ll, LLIterateCallback iterate, void* params) {
  */
 void* ll_get_last(LinkedList q) {
   if (ll_is_empty(q)) return NULL;
-  LinkedNode* node = (*q);
-  while (node->next != NULL) {
-    node = node->next;
-  }
-  return node->data;
+  return q->tail->data;
 }
 
 /**
@@ -139,36 +143,32 @@ void* ll_get_last(LinkedList q) {
  */
 void* ll_get_first(LinkedList q) {
   if (ll_is_empty(q)) return NULL;
-  return (*q)->data;
+  return q->head->data;
 }
 
 /**
  * Test whether a given queue is empty.
  */
 int ll_is_empty(LinkedList q) {
-  return ((*q) == NULL);
+  return (q->head == NULL);
 }
 
 /**
  * Compute queue size.
  */
 int ll_size(LinkedList q) {
-  LinkedNode* node = (*q);
-  int size = 0;
-  while (node != NULL) {
-    size++;
-    node = node->next;
-  }
-  return size;
+  return q->size;
 }
 
 /**
  * Create a queue datastructure.
  */
 LinkedList ll_create() {
-  LinkedList head = (LinkedList) malloc(sizeof(LinkedNode*));
-  (*head) = NULL;
-  return head;
+  LinkedList q = (LinkedList) pool_alloc(&ll_header_pool);
+  q->head = NULL;
+  q->tail = NULL;
+  q->size = 0;
+  return q;
 }
 
 /**
@@ -176,7 +176,7 @@ LinkedList ll_create() {
  */
 LinkedList ll_copy(LinkedList q) {
   LinkedList copy = ll_create();
-  LinkedNode* node = (*q);
+  LinkedNode* node = q->head;
   while (node != NULL) {
     ll_enqueue(copy, node->data);
     node = node->next;
@@ -189,7 +189,7 @@ LinkedList ll_copy(LinkedList q) {
  */
 LinkedList ll_copy_data(LinkedList q, LLCopyDataCallback copy_data) {
   LinkedList copy = ll_create();
-  LinkedNode* node = (*q);
+  LinkedNode* node = q->head;
   while (node != NULL) {
     ll_push(copy, copy_data(node->data));
     node = node->next;
@@ -211,7 +211,7 @@ void ll_clear(LinkedList q, LLDestroyDataCallback destroy) {
  */
 void ll_destroy(LinkedList q, LLDestroyDataCallback destroy) {
   ll_clear(q, destroy);
-  free(q);
+  pool_free(&ll_header_pool, q);
 }
 
 /**
@@ -220,7 +220,7 @@ void ll_destroy(LinkedList q, LLDestroyDataCallback destroy) {
 void** ll_to_array(LinkedList ll) {
   int size = ll_size(ll);
   void** array = calloc(size, sizeof(void*));
-  LinkedNode* node = (*ll);
+  LinkedNode* node = ll->head;
   for (int i = 0; i < size; i++) {
     if (node == NULL) break;
     array[i] = node->data;
@@ -228,3 +228,20 @@ void** ll_to_array(LinkedList ll) {
   }
   return array;
 }
+
+/**
+ * Add the reuse counts of the calling thread to the shared stats.
+ */
+void ll_pool_flush() {
+  pool_flush(&ll_header_pool);
+  pool_flush(&ll_node_pool);
+}
+
+/**
+ * Free the list headers and nodes kept for reuse by the calling thread.
+ * Every thread creating lists should call this before exiting.
+ */
+void ll_pool_drain() {
+  pool_drain(&ll_header_pool);
+  pool_drain(&ll_node_pool);
+}
@@ -1,6 +1,8 @@
 #include <stdio.h>
 #include <stdlib.h>
 
+#include "pool.h"
+
 #ifndef LINKEDLIST
 #define LINKEDLIST
 
@@ -11,8 +13,18 @@ struct LinkedNode {
   LinkedNode* next;
 };
 
-// Datastructure for a linked list.
-typedef LinkedNode** LinkedList;
+// Datastructure for a linked list, keeping track of both of its ends
+// and of its size, so appending and measuring it take constant time.
+typedef struct LinkedListHeader LinkedListHeader;
+struct LinkedListHeader {
+  LinkedNode* head;
+  LinkedNode* tail;
+  int size;
+};
+typedef LinkedListHeader* LinkedList;
+
+// Reuse of list headers and nodes by the pools of all threads.
+extern PoolStats ll_pool_stats;
 
 // Callback function types.
 typedef int (*LLCompareDataCallback)(void* data1, void* data2);
@@ -40,5 +52,7 @@ void ll_clear(LinkedList q, LLDestroyDataCallback destroy);
 void ll_destroy(LinkedList q, LLDestroyDataCallback destroy);
 void ll_iterate(LinkedList ll, LLIterateCallback iterate, void* params);
 void** ll_to_array(LinkedList ll);
+void ll_pool_flush();
+void ll_pool_drain();
 
 #endif
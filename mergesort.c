@@ -1,6 +1,8 @@
 #include "mergesort.h"
 
 void mergesort(void** array, int size, MSCompareFunction compare) {
+  // Splitting fewer than two elements over the threads leaves one without any.
+  if (size < 2) return;
   // Use two threads for sorting.
   int tc = 2;
   // Build list datastructure to work with.
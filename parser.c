@@ -1,11 +1,38 @@
+#include <fcntl.h>
+#include <limits.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
 #include "parser.h"
+#include "mergesort.h"
+#include "vector.h"
+
+// Datastructure for a thread extracting the words from one chunk of a file.
+// Words are copied into one buffer, so no allocation per word is needed.
+typedef struct ParserChunk ParserChunk;
+struct ParserChunk {
+  const char* start;
+  const char* end;
+  int policy;
+  char* buffer;
+  char** words;
+  int count;
+};
+
+void* parse_dictionary_chunk(void* params);
+char* parser_index_file_name(const char file_name[]);
+size_t parser_read_range(int fd, char** text, size_t* capacity, size_t length, uint64_t start, uint64_t end);
 
 /**
  * Reads through all characters in a specified file sequentially,
  * putting them into a puzzle matrix from left to right, top to bottom.
  * Also supports cells with multiple letters.
+ * A size of 0 takes the size from the number of cells in the file,
+ * which then has to be a square.
  */
-void parse_puzzle_from_file(const char file_name[], Puzzle* puzzle) {
+Puzzle* parse_puzzle_from_file(const char file_name[], int size) {
   FILE* fp = fopen(file_name, "r");
 
   printf("Building puzzle datastructure from: '%s'\n", file_name);
@@ -14,34 +41,50 @@ void parse_puzzle_from_file(const char file_name[], Puzzle* puzzle) {
     exit(-1);
   }
 
+  // Cells beyond the largest puzzle are only counted.
+  PuzzleCell cells[PZ_MAX_CELLS];
+  int limit = (size > 0) ? size * size : INT_MAX;
   char ch;
   int id = 0;
   int expecting = 1;
-  PuzzleCell* cell = pz_create_cell(id, 0, '\0', '\0');
+  PuzzleCell cell = {id, 0, '\0', '\0'};
   while ((ch = fgetc(fp)) != EOF) {
     if (ch == '(' || ch == '/') {
       expecting = 2;
-      cell->type = (ch == '(') ? 1 : 2;
+      cell.type = (ch == '(') ? 1 : 2;
       continue;
     }
     if (expecting && isalpha(ch)) {
-      if (cell->c1 == '\0') {
-        cell->c1 = ch;
+      if (cell.c1 == '\0') {
+        cell.c1 = ch;
       } else {
-        cell->c2 = ch;
+        cell.c2 = ch;
       }
       --expecting;
     }
     if (!expecting) {
-      pz_add_cell(puzzle, cell);
+      if (id < PZ_MAX_CELLS) cells[id] = cell;
       expecting = 1;
       ++id;
-      cell = pz_create_cell(id, 0, '\0', '\0');
+      cell = (PuzzleCell) {id, 0, '\0', '\0'};
     }
-    if (id >= puzzle->size * puzzle->size) break;
+    if (id >= limit) break;
   }
 
   fclose(fp);
+
+  if (size == 0) {
+    while ((size + 1) * (size + 1) <= id) size++;
+  }
+  if (size == 0 || size * size != id) {
+    printf("Error: %i cells in file '%s' do not form a square puzzle\n", id, file_name);
+    exit(-1);
+  }
+  Puzzle* puzzle = pz_create(size);
+  for (int i = 0; i < id; i++) {
+    pz_add_cell(puzzle, &cells[i]);
+  }
+  return puzzle;
 }
 
 /**
@@ -59,7 +102,8 @@ void parse_dictionary_from_file(const char file_name[], HashMap* hm) {
 
   char ch;
   char* prefix = (char*) calloc(4, sizeof(char));
-  LinkedList word = ll_create();
+  CharVector word;
+  cv_init(&word);
   prefix[3] = '\0';
   int count = 0;
   int pos = 0;
@@ -70,7 +114,7 @@ void parse_dictionary_from_file(const char file_name[], HashMap* hm) {
         prefix[pos] = ch;
         pos += 1;
       }
-      ll_enqueue(word, box_char(ch));
+      cv_push(&word, ch);
     } else {
       reading = 0;
     }
@@ -83,18 +127,449 @@ void parse_dictionary_from_file(const char file_name[], HashMap* hm) {
           count++;
         }
         LinkedList words = (LinkedList) get_data(hm, prefix);
-        char* string = pz_ll_collapse_word(word);
+        char* string = cv_to_string(&word);
         //printf("Adding word to dictionary: %s\n", string);
         ll_enqueue(words, string);
       }
-      ll_clear(word, destroy_char);
+      cv_clear(&word);
       reading = 1;
       pos = 0;
     }
   }
 
-  ll_destroy(word, destroy_char);
+  cv_free(&word);
   free(prefix);
 
   fclose(fp);
 }
+
+/**
+ * Normalize one line of a dictionary file, ending at a newline or at end,
+ * into a word according to a policy.
+ * Returns the length of the word, or 0 if the line holds no playable word.
+ */
+int parser_normalize_word(const char* line, const char* end, char* out, int policy) {
+  int pos = 0;
+  for (const char* p = line; p < end && *p != '\n'; p++) {
+    unsigned char ch = *p;
+    if (isalpha(ch)) {
+      if (pos == PARSER_MAX_WORD_LENGTH) return (policy == PARSER_POLICY_TRUNCATE) ? pos : 0;
+      out[pos++] = tolower(ch);
+    } else if (policy == PARSER_POLICY_TRUNCATE) {
+      break;
+    } else if (policy == PARSER_POLICY_JOIN && (ch == '-' || ch == '\'')) {
+      continue;
+    } else if (isspace(ch)) {
+      // Trailing whitespace is allowed, whitespace within an entry is not.
+      while (p < end && *p != '\n' && isspace((unsigned char) *p)) p++;
+      if (p < end && *p != '\n') return 0;
+      break;
+    } else {
+      return 0;
+    }
+  }
+  return pos;
+}
+
+/**
+ * Build a trie containing all words in a specified file,
+ * normalizing every line according to a policy.
+ * Returns NULL if the file cannot be read.
+ */
+Dictionary* parse_dictionary_trie_from_file(const char file_name[], int policy) {
+  FILE* fp = fopen(file_name, "r");
+
+  printf("Building dictionary datastructure from: '%s'\n", file_name);
+  if (fp == NULL) {
+    printf("Error: unable to open file '%s'\n", file_name);
+    return NULL;
+  }
+
+  int capacity = 1024;
+  int count = 0;
+  char** words = malloc(capacity * sizeof(char*));
+  char word[PARSER_MAX_WORD_LENGTH + 1];
+  char* line = NULL;
+  size_t line_capacity = 0;
+  ssize_t length;
+  while ((length = getline(&line, &line_capacity, fp)) != -1) {
+    int pos = parser_normalize_word(line, line + length, word, policy);
+    if (pos == 0) continue;
+    word[pos] = '\0';
+    if (count == capacity) {
+      capacity *= 2;
+      words = realloc(words, capacity * sizeof(char*));
+    }
+    words[count++] = strdup(word);
+  }
+  free(line);
+
+  int failed = ferror(fp);
+  fclose(fp);
+
+  Dictionary* dict = NULL;
+  if (failed) {
+    printf("Error: unable to read file '%s'\n", file_name);
+  } else {
+    dict = dict_create(words, count);
+  }
+  for (int i = 0; i < count; i++) {
+    free(words[i]);
+  }
+  free(words);
+  return dict;
+}
+
+/**
+ * Extract the normalized words of a dictionary file using a number of threads.
+ * The file is mapped into memory and split into chunks at line boundaries,
+ * the words of every chunk are extracted by a different thread.
+ * The words are sorted if needed and duplicates are removed.
+ * Returns NULL if the file cannot be read.
+ */
+ParserWords* parse_words_from_file(const char file_name[], int tc, int policy) {
+  int fd = open(file_name, O_RDONLY);
+  struct stat st;
+  if (fd < 0 || fstat(fd, &st) != 0) {
+    printf("Error: unable to open file '%s'\n", file_name);
+    if (fd >= 0) close(fd);
+    return NULL;
+  }
+  size_t length = st.st_size;
+  char* text = NULL;
+  if (length > 0) {
+    text = mmap(NULL, length, PROT_READ, MAP_PRIVATE, fd, 0);
+  }
+  close(fd);
+  if (text == MAP_FAILED) {
+    printf("Error: unable to map file '%s'\n", file_name);
+    return NULL;
+  }
+  ParserWords* result = malloc(sizeof(ParserWords));
+  result->count = 0;
+  result->buffer_count = 0;
+  result->buffers = NULL;
+  result->words = NULL;
+  if (length == 0) return result;
+  madvise(text, length, MADV_SEQUENTIAL);
+
+  // Split the file into chunks, every chunk ending after a newline.
+  if (tc < 1) tc = 1;
+  pthread_t threads[tc];
+  ParserChunk chunks[tc];
+  const char* start = text;
+  const char* end = text + length;
+  for (int tid = 0; tid < tc; tid++) {
+    const char* chunk_end = (tid == tc - 1) ? end : text + length * (tid + 1) / tc;
+    if (chunk_end < start) chunk_end = start;
+    if (chunk_end < end && chunk_end > text && chunk_end[-1] != '\n') {
+      const char* newline = memchr(chunk_end, '\n', end - chunk_end);
+      chunk_end = (newline == NULL) ? end : newline + 1;
+    }
+    chunks[tid] = (ParserChunk) {start, chunk_end, policy, NULL, NULL, 0};
+    if (pthread_create(&threads[tid], NULL, parse_dictionary_chunk, &chunks[tid])) {
+      printf("Error: failed to create thread %i.\n", tid);
+      exit(1);
+    }
+    start = chunk_end;
+  }
+
+  int count = 0;
+  for (int tid = 0; tid < tc; tid++) {
+    if (pthread_join(threads[tid], NULL)) {
+      printf("Error: failed to join thread %i.\n", tid);
+      exit(2);
+    }
+    count += chunks[tid].count;
+  }
+  munmap(text, length);
+
+  // Merge the words of all chunks, keeping the order of the file.
+  result->words = malloc((count > 0 ? count : 1) * sizeof(char*));
+  result->buffers = malloc(tc * sizeof(char*));
+  result->buffer_count = tc;
+  for (int tid = 0; tid < tc; tid++) {
+    memcpy(&result->words[result->count], chunks[tid].words, chunks[tid].count * sizeof(char*));
+    result->count += chunks[tid].count;
+    result->buffers[tid] = chunks[tid].buffer;
+    free(chunks[tid].words);
+  }
+
+  // Joined words may end up out of order, and different lines may
+  // normalize to the same word.
+  if (result->count > 1 && !dict_words_sorted(result->words, result->count)) {
+    mergesort((void**) result->words, result->count, &dict_compare_words);
+  }
+  int unique = 0;
+  for (int i = 0; i < result->count; i++) {
+    if (unique == 0 || strcmp(result->words[unique - 1], result->words[i]) != 0) {
+      result->words[unique++] = result->words[i];
+    }
+  }
+  result->count = unique;
+  return result;
+}
+
+void parser_destroy_words(ParserWords* words) {
+  for (int i = 0; i < words->buffer_count; i++) {
+    free(words->buffers[i]);
+  }
+  free(words->buffers);
+  free(words->words);
+  free(words);
+}
+
+/**
+ * Build a trie containing all words in a specified file, like
+ * parse_dictionary_trie_from_file, using a number of threads.
+ */
+Dictionary* parse_dictionary_parallel_from_file(const char file_name[], int tc, int policy) {
+  printf("Building dictionary datastructure from: '%s'\n", file_name);
+  ParserWords* words = parse_words_from_file(file_name, tc, policy);
+  if (words == NULL) return NULL;
+  Dictionary* dict = dict_create_parallel(words->words, words->count, tc);
+  parser_destroy_words(words);
+  return dict;
+}
+
+/**
+ * Build a packed dictionary containing all words in a specified file,
+ * without building a trie for all of them. Returns NULL if the file
+ * cannot be read.
+ */
+Dictionary* parse_dictionary_packed_from_file(const char file_name[], int tc, int policy) {
+  printf("Building packed dictionary from: '%s'\n", file_name);
+  ParserWords* words = parse_words_from_file(file_name, tc, policy);
+  if (words == NULL) return NULL;
+  Dictionary* dict = dict_create_packed(words->words, NULL, words->count);
+  parser_destroy_words(words);
+  return dict;
+}
+
+/**
+ * Write the normalized words of a dictionary file to another file,
+ * sorted and without duplicates, one per line. Returns 0 on success.
+ */
+int normalize_dictionary_file(const char file_name[], const char output_file_name[], int tc, int policy) {
+  printf("Normalizing dictionary: '%s'\n", file_name);
+  ParserWords* words = parse_words_from_file(file_name, tc, policy);
+  if (words == NULL) return -1;
+  FILE* fp = fopen(output_file_name, "w");
+  int ok = fp != NULL;
+  for (int i = 0; ok && i < words->count; i++) {
+    ok = fputs(words->words[i], fp) >= 0 && fputc('\n', fp) != EOF;
+  }
+  if (fp != NULL && fclose(fp) != 0) ok = 0;
+  if (ok) {
+    printf("Wrote %i words to: '%s'\n", words->count, output_file_name);
+  } else {
+    printf("Error: unable to write file '%s'\n", output_file_name);
+  }
+  parser_destroy_words(words);
+  return ok ? 0 : -1;
+}
+
+/**
+ * Thread: extract the normalized word of every line in a chunk of a file.
+ */
+void* parse_dictionary_chunk(void* params) {
+  ParserChunk* chunk = (ParserChunk*) params;
+  // Every word and its terminator fit in the space of its line and newline.
+  chunk->buffer = malloc(chunk->end - chunk->start + 1);
+  int capacity = 1024;
+  chunk->words = malloc(capacity * sizeof(char*));
+
+  char* out = chunk->buffer;
+  const char* line = chunk->start;
+  while (line < chunk->end) {
+    const char* newline = memchr(line, '\n', chunk->end - line);
+    const char* line_end = (newline == NULL) ? chunk->end : newline;
+    int pos = parser_normalize_word(line, line_end, out, chunk->policy);
+    if (pos > 0) {
+      out[pos] = '\0';
+      if (chunk->count == capacity) {
+        capacity *= 2;
+        chunk->words = realloc(chunk->words, capacity * sizeof(char*));
+      }
+      chunk->words[chunk->count++] = out;
+      out += pos + 1;
+    }
+    line = line_end + 1;
+  }
+  return NULL;
+}
+
+/**
+ * Get the position of a word in the index, by its first letters.
+ * Returns -1 for words that do not start with a letter.
+ */
+int parser_index_entry(const char* word, int length) {
+  if (length > PARSER_INDEX_PREFIX_LENGTH) length = PARSER_INDEX_PREFIX_LENGTH;
+  int entry = 0;
+  int offset = 0;
+  int level = 1;
+  for (int i = 0; i < length; i++) {
+    int letter = dict_letter(word[i]);
+    if (letter < 0) return -1;
+    entry = entry * 26 + letter;
+    if (i > 0) offset += level;
+    level *= 26;
+  }
+  return (length == 0) ? -1 : offset + entry;
+}
+
+/**
+ * Append a range of lines of a file to a buffer, returning the new length.
+ */
+size_t parser_read_range(int fd, char** text, size_t* capacity, size_t length, uint64_t start, uint64_t end) {
+  if (end <= start) return length;
+  while (length + (end - start) + 1 > *capacity) *capacity *= 2;
+  *text = realloc(*text, *capacity);
+  ssize_t count = pread(fd, &(*text)[length], end - start, start);
+  if (count <= 0) return length;
+  length += count;
+  if ((*text)[length - 1] != '\n') (*text)[length++] = '\n';
+  return length;
+}
+
+char* parser_index_file_name(const char file_name[]) {
+  char* index_name = malloc(strlen(file_name) + strlen(PARSER_INDEX_SUFFIX) + 1);
+  strcpy(index_name, file_name);
+  strcat(index_name, PARSER_INDEX_SUFFIX);
+  return index_name;
+}
+
+/**
+ * Write the sidecar index of a sorted dictionary file.
+ * Returns 0 on success.
+ */
+int index_dictionary_file(const char file_name[]) {
+  printf("Indexing dictionary: '%s'\n", file_name);
+  int fd = open(file_name, O_RDONLY);
+  struct stat st;
+  if (fd < 0 || fstat(fd, &st) != 0) {
+    printf("Error: unable to open file '%s'\n", file_name);
+    return -1;
+  }
+  size_t length = st.st_size;
+  char* text = (length > 0) ? mmap(NULL, length, PROT_READ, MAP_PRIVATE, fd, 0) : NULL;
+  close(fd);
+  if (text == MAP_FAILED) {
+    printf("Error: unable to map file '%s'\n", file_name);
+    return -1;
+  }
+
+  ParserIndexRange* ranges = calloc(PARSER_INDEX_ENTRIES, sizeof(ParserIndexRange));
+  const char* line = text;
+  const char* end = text + length;
+  while (line < end) {
+    const char* newline = memchr(line, '\n', end - line);
+    const char* line_end = (newline == NULL) ? end : newline + 1;
+    char prefix[PARSER_INDEX_PREFIX_LENGTH];
+    int pos = 0;
+    for (const char* p = line; p < line_end && pos < PARSER_INDEX_PREFIX_LENGTH; p++) {
+      if (*p == '-' || *p == '\'') continue;
+      if (!isalpha((unsigned char) *p)) break;
+      prefix[pos++] = *p;
+    }
+    int entry = parser_index_entry(prefix, pos);
+    if (entry >= 0) {
+      // Lines are expected to be sorted, but ranges cover out of order lines as well.
+      ParserIndexRange* range = &ranges[entry];
+      uint64_t start = line - text;
+      uint64_t stop = line_end - text;
+      if (range->start == range->end || start < range->start) range->start = start;
+      if (stop > range->end) range->end = stop;
+    }
+    line = line_end;
+  }
+  if (text != NULL) munmap(text, length);
+
+  ParserIndexHeader header;
+  memcpy(header.magic, PARSER_INDEX_MAGIC, sizeof(header.magic));
+  header.version = PARSER_INDEX_VERSION;
+  header.text_size = st.st_size;
+  header.text_mtime = st.st_mtime;
+
+  char* index_name = parser_index_file_name(file_name);
+  FILE* fp = fopen(index_name, "wb");
+  int ok = fp != NULL
+    && fwrite(&header, sizeof(header), 1, fp) == 1
+    && fwrite(ranges, sizeof(ParserIndexRange), PARSER_INDEX_ENTRIES, fp) == PARSER_INDEX_ENTRIES;
+  if (fp != NULL && fclose(fp) != 0) ok = 0;
+  if (ok) {
+    printf("Wrote dictionary index to: '%s'\n", index_name);
+  } else {
+    printf("Error: unable to write file '%s'\n", index_name);
+  }
+  free(index_name);
+  free(ranges);
+  return ok ? 0 : -1;
+}
+
+/**
+ * Build a trie containing only the words of a dictionary file starting with
+ * one of the marked three letter prefixes, reading just their lines.
+ * Returns NULL if the file has no up to date sidecar index.
+ */
+Dictionary* parse_dictionary_prefixes_from_file(const char file_name[], const uint8_t* prefixes, int policy) {
+  char* index_name = parser_index_file_name(file_name);
+  FILE* fp = fopen(index_name, "rb");
+  free(index_name);
+  if (fp == NULL) return NULL;
+
+  struct stat st;
+  ParserIndexHeader header;
+  ParserIndexRange* ranges = malloc(PARSER_INDEX_ENTRIES * sizeof(ParserIndexRange));
+  int ok = stat(file_name, &st) == 0
+    && fread(&header, sizeof(header), 1, fp) == 1
+    && memcmp(header.magic, PARSER_INDEX_MAGIC, sizeof(header.magic)) == 0
+    && header.version == PARSER_INDEX_VERSION
+    && header.text_size == (uint64_t) st.st_size
+    && header.text_mtime == (int64_t) st.st_mtime
+    && fread(ranges, sizeof(ParserIndexRange), PARSER_INDEX_ENTRIES, fp) == PARSER_INDEX_ENTRIES;
+  fclose(fp);
+  if (!ok) {
+    printf("Ignoring outdated index of dictionary '%s'\n", file_name);
+    free(ranges);
+    return NULL;
+  }
+
+  int fd = open(file_name, O_RDONLY);
+  if (fd < 0) {
+    free(ranges);
+    return NULL;
+  }
+  printf("Building dictionary datastructure from indexed prefixes of: '%s'\n", file_name);
+
+  // Read the ranges of all marked prefixes, merging ranges that touch.
+  int first = parser_index_entry("aaa", PARSER_INDEX_PREFIX_LENGTH);
+  size_t capacity = 4096;
+  size_t length = 0;
+  char* text = malloc(capacity);
+  uint64_t start = 0;
+  uint64_t end = 0;
+  for (int entry = first; entry < PARSER_INDEX_ENTRIES; entry++) {
+    ParserIndexRange range = ranges[entry];
+    if (!prefixes[entry - first] || range.start == range.end) continue;
+    if (end > start && range.start <= end && range.end >= start) {
+      if (range.start < start) start = range.start;
+      if (range.end > end) end = range.end;
+      continue;
+    }
+    length = parser_read_range(fd, &text, &capacity, length, start, end);
+    start = range.start;
+    end = range.end;
+  }
+  length = parser_read_range(fd, &text, &capacity, length, start, end);
+  close(fd);
+  free(ranges);
+
+  ParserChunk chunk = {text, text + length, policy, NULL, NULL, 0};
+  parse_dictionary_chunk(&chunk);
+  Dictionary* dict = dict_create(chunk.words, chunk.count);
+  free(chunk.words);
+  free(chunk.buffer);
+  free(text);
+  return dict;
+}
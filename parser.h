@@ -2,6 +2,63 @@
 #include <ctype.h>
 #include "puzzle.h"
 #include "hashmap.h"
+#include "dictionary.h"
 
-void parse_puzzle_from_file(const char file_name[], Puzzle* puzzle);
+// Longer words are truncated while parsing a dictionary.
+#define PARSER_MAX_WORD_LENGTH DICT_MAX_WORD_LENGTH
+
+// Policies for normalizing the lines of a dictionary file into words.
+// Letters are always folded to lowercase. Truncating keeps the letters before
+// the first other character, the legacy behaviour. Otherwise lines with
+// characters other than letters are dropped, except that hyphens and
+// apostrophes are removed when joining ("a-capella" becomes "acapella").
+#define PARSER_POLICY_TRUNCATE 0
+#define PARSER_POLICY_DROP 1
+#define PARSER_POLICY_JOIN 2
+
+// Datastructure for the normalized words of a dictionary file, sorted and
+// without duplicates. The words themselves are stored in a few large buffers.
+typedef struct ParserWords ParserWords;
+struct ParserWords {
+  char** words;
+  int count;
+  char** buffers;
+  int buffer_count;
+};
+
+// A sidecar index maps the prefixes of the words in a sorted dictionary file
+// to the byte ranges of the lines starting with them. Words are indexed by
+// their first three letters, or all of their letters when they are shorter.
+// Hyphens and apostrophes are skipped, so the index serves every policy.
+#define PARSER_INDEX_MAGIC "WDIX"
+#define PARSER_INDEX_VERSION 2
+#define PARSER_INDEX_SUFFIX ".idx"
+#define PARSER_INDEX_PREFIX_LENGTH 3
+#define PARSER_INDEX_ENTRIES (26 + 26 * 26 + 26 * 26 * 26)
+
+typedef struct ParserIndexHeader ParserIndexHeader;
+struct ParserIndexHeader {
+  char magic[4];
+  uint32_t version;
+  uint64_t text_size;
+  int64_t text_mtime;
+};
+
+typedef struct ParserIndexRange ParserIndexRange;
+struct ParserIndexRange {
+  uint64_t start;
+  uint64_t end;
+};
+
+Puzzle* parse_puzzle_from_file(const char file_name[], int size);
 void parse_dictionary_from_file(const char file_name[], HashMap* dictionary);
+int parser_normalize_word(const char* line, const char* end, char* out, int policy);
+ParserWords* parse_words_from_file(const char file_name[], int tc, int policy);
+void parser_destroy_words(ParserWords* words);
+int normalize_dictionary_file(const char file_name[], const char output_file_name[], int tc, int policy);
+Dictionary* parse_dictionary_trie_from_file(const char file_name[], int policy);
+Dictionary* parse_dictionary_parallel_from_file(const char file_name[], int tc, int policy);
+Dictionary* parse_dictionary_packed_from_file(const char file_name[], int tc, int policy);
+int parser_index_entry(const char* word, int length);
+int index_dictionary_file(const char file_name[]);
+Dictionary* parse_dictionary_prefixes_from_file(const char file_name[], const uint8_t* prefixes, int policy);
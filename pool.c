@@ -0,0 +1,57 @@
+#include "pool.h"
+
+/**
+ * Get an object from the pool, or allocate one if the pool is empty.
+ */
+void* pool_alloc(Pool* pool) {
+  void* object = pool->free;
+  if (object == NULL) {
+    pool->misses++;
+    return malloc(pool->object_size);
+  }
+  pool->free = *(void**) object;
+  pool->count--;
+  pool->hits++;
+  return object;
+}
+
+/**
+ * Return an object to the pool. Objects beyond its maximum are freed.
+ * An object may be returned to the pool of another thread than the one
+ * it came from.
+ */
+void pool_free(Pool* pool, void* object) {
+  if (pool->count >= pool->max_free) {
+    free(object);
+    return;
+  }
+  *(void**) object = pool->free;
+  pool->free = object;
+  pool->count++;
+}
+
+/**
+ * Add the counts of a pool to the shared stats, keeping its objects.
+ */
+void pool_flush(Pool* pool) {
+  if (pool->stats != NULL) {
+    __atomic_add_fetch(&pool->stats->hits, pool->hits, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&pool->stats->misses, pool->misses, __ATOMIC_RELAXED);
+  }
+  pool->hits = 0;
+  pool->misses = 0;
+}
+
+/**
+ * Free all objects kept by a pool and add its counts to the shared stats.
+ * Call it before a thread using the pool exits.
+ */
+void pool_drain(Pool* pool) {
+  while (pool->free != NULL) {
+    void* object = pool->free;
+    pool->free = *(void**) object;
+    free(object);
+  }
+  pool->count = 0;
+  pool_flush(pool);
+}
@@ -0,0 +1,36 @@
+#include <stdlib.h>
+
+#ifndef POOL
+#define POOL
+
+// Default maximum number of freed objects a pool keeps for reuse.
+#define POOL_MAX_FREE 65536
+
+// Datastructure for counting how many objects of one kind were reused
+// and how many had to be allocated, summed over all threads.
+typedef struct PoolStats PoolStats;
+struct PoolStats {
+  long hits;
+  long misses;
+};
+
+// Datastructure for a free list of objects of one size, owned by one thread,
+// so objects are reused without locking. Declare pools __thread.
+// A freed object stores the pointer to the next free object in its first bytes.
+typedef struct Pool Pool;
+struct Pool {
+  size_t object_size;
+  PoolStats* stats;
+  int max_free;
+  void* free;
+  int count;
+  long hits;
+  long misses;
+};
+
+void* pool_alloc(Pool* pool);
+void pool_free(Pool* pool, void* object);
+void pool_flush(Pool* pool);
+void pool_drain(Pool* pool);
+
+#endif
@@ -13,7 +13,7 @@ void print_puzzle(Puzzle* puzzle) {
     } else {
       printf("[%c/%c] ", cell->c1, cell->c2);
     }
-    if ((i+1) % 4 == 0) printf("\n");
+    if ((i+1) % puzzle->size == 0) printf("\n");
   }
 }
 
@@ -27,11 +27,9 @@ void print_puzzle_cell(PuzzleCell* cell) {
 /**
  * Print a puzzle path.
  */
- void print_puzzle_path(PuzzlePath* path) {
-   LinkedNode* cell = (*path->cells);
-   while (cell != NULL) {
-     print_puzzle_cell((PuzzleCell*) cell->data);
-     cell = cell->next;
+ void print_puzzle_path(Puzzle* puzzle, PuzzlePath* path) {
+   for (int i = 0; i < path->cell_count; i++) {
+     print_puzzle_cell(pz_get_cell(puzzle, path->cells[i]));
    }
    printf("\n");
  }
@@ -3,4 +3,4 @@
 
 void print_puzzle(Puzzle* puzzle);
 void print_puzzle_cell(PuzzleCell* cell);
-void print_puzzle_path(PuzzlePath* path);
+void print_puzzle_path(Puzzle* puzzle, PuzzlePath* path);
@@ -2,43 +2,97 @@
 
 void pz_init(Puzzle* pz) {
   for (int i = 0; i < pz->size * pz->size; i++) {
-    pz->cells[i] = pz_create_cell(i, 0, '\0', '\0');
+    pz->cells[i] = (PuzzleCell) {i, 0, '\0', '\0'};
   }
 }
 
+/**
+ * Compute the ids of the neighbors of every cell, in a fixed order.
+ */
+void pz_build_neighbors(Puzzle* pz) {
+  static const int pz_cell_neighbors_x[PZ_NEIGHBORS] = {-1, 0, 1, 1, 1, 0, -1, -1};
+  static const int pz_cell_neighbors_y[PZ_NEIGHBORS] = {-1, -1, -1, 0, 1, 1, 1, 0};
+  int count = 0;
+  for (int i = 0; i < pz->size * pz->size; i++) {
+    PuzzleCell* cell = &pz->cells[i];
+    pz->neighbor_start[i] = count;
+    for (int n = 0; n < PZ_NEIGHBORS; n++) {
+      int id = pz_xy_to_id(pz, pz_cell_x(pz, cell) + pz_cell_neighbors_x[n], pz_cell_y(pz, cell) + pz_cell_neighbors_y[n]);
+      if (id >= 0) pz->neighbors[count++] = id;
+    }
+  }
+  pz->neighbor_start[pz->size * pz->size] = count;
+}
+
 Puzzle* pz_create(int size) {
+  if (size < 1 || size > PZ_MAX_SIZE) {
+    printf("Error: puzzle size %i is not supported, the maximum is %i.\n", size, PZ_MAX_SIZE);
+    exit(1);
+  }
   Puzzle* pz = malloc(sizeof(Puzzle));
   pz->size = size;
   pz->cells = calloc(size * size, sizeof(PuzzleCell));
+  pz->neighbor_start = calloc(size * size + 1, sizeof(uint16_t));
+  pz->neighbors = calloc(size * size * PZ_NEIGHBORS, sizeof(uint8_t));
   pz_init(pz);
+  pz_build_neighbors(pz);
   return pz;
 }
 
 void pz_destroy(Puzzle* pz) {
-  for (int i = 0; i < pz->size * pz->size; i++) {
-    pz_destroy_cell(pz->cells[i]);
-  }
+  free(pz->neighbors);
+  free(pz->neighbor_start);
+  free(pz->cells);
   free(pz);
 }
 
+// Freed paths are kept for reuse by the same thread.
+PoolStats pz_pool_stats;
+__thread Pool pz_path_pool = {sizeof(PuzzlePath), &pz_pool_stats, POOL_MAX_FREE, NULL, 0, 0, 0};
+
 PuzzlePath* pz_create_path() {
-  PuzzlePath* path = malloc(sizeof(PuzzlePath));
-  path->cells = ll_create();
-  path->word = ll_create();
+  PuzzlePath* path = pool_alloc(&pz_path_pool);
+  pz_init_path(path);
   return path;
 }
 
-PuzzlePath* pz_copy_path(PuzzlePath* path) {
-  PuzzlePath* new_path = (PuzzlePath*) malloc(sizeof(PuzzlePath));
-  new_path->cells = ll_copy(path->cells);
-  new_path->word = ll_copy_data(path->word, copy_char);
+/**
+ * Make a path empty, for paths not allocated by pz_create_path.
+ */
+void pz_init_path(PuzzlePath* path) {
+  path->cell_count = 0;
+  path->length = 0;
+  path->word[0] = '\0';
+  path->visited = 0;
+  path->node = DICT_ROOT;
+}
+
+PuzzlePath* pz_copy_path(const PuzzlePath* path) {
+  PuzzlePath* new_path = (PuzzlePath*) pool_alloc(&pz_path_pool);
+  *new_path = *path;
   return new_path;
 }
 
 void pz_destroy_path(PuzzlePath* path) {
-  ll_destroy(path->cells, NULL);
-  ll_destroy(path->word, destroy_char);
-  free(path);
+  pool_free(&pz_path_pool, path);
+}
+
+/**
+ * Add the reuse counts of the paths and lists of the calling thread
+ * to the shared stats.
+ */
+void pz_pool_flush() {
+  pool_flush(&pz_path_pool);
+  ll_pool_flush();
+}
+
+/**
+ * Free the paths kept for reuse by the calling thread, and its lists.
+ * Every thread creating paths should call this before exiting.
+ */
+void pz_pool_drain() {
+  pool_drain(&pz_path_pool);
+  ll_pool_drain();
 }
 void pz_ll_destroy_path(void* data) {
   pz_destroy_path((PuzzlePath*) data);
@@ -60,18 +114,18 @@ void pz_ll_destroy_cell(void* data) {
   pz_destroy_cell((PuzzleCell*) data);
 }
 
+/**
+ * Copy a cell into the puzzle, at the position given by its id.
+ */
 void pz_add_cell(Puzzle* pz, PuzzleCell* cell) {
   if (pz_valid_cell_id(pz, cell->id)) {
-    if (pz->cells[cell->id] != NULL) {
-      pz_destroy_cell(pz->cells[cell->id]);
-    }
-    pz->cells[cell->id] = cell;
+    pz->cells[cell->id] = *cell;
   }
 }
 
 PuzzleCell* pz_get_cell(Puzzle* pz, int id) {
   if (pz_valid_cell_id(pz, id)) {
-    return pz->cells[id];
+    return &pz->cells[id];
   }
   return NULL;
 }
@@ -79,17 +133,95 @@ PuzzleCell* pz_get_cell_xy(Puzzle* pz, int x, int y) {
   return pz_get_cell(pz, pz_xy_to_id(pz, x, y));
 }
 
-LinkedList pz_get_cell_neighbors(Puzzle* pz, PuzzleCell* cell) {
-  int pz_cell_neighbors_x[8] = {-1, 0, 1, 1, 1, 0, -1, -1};
-  int pz_cell_neighbors_y[8] = {-1, -1, -1, 0, 1, 1, 1, 0};
-  LinkedList neighbors = ll_create();
-  for (int i = 0; i < 8; i++) {
-    int x = pz_cell_x(pz, cell) + pz_cell_neighbors_x[i];
-    int y = pz_cell_y(pz, cell) + pz_cell_neighbors_y[i];
-    PuzzleCell* cell = pz_get_cell_xy(pz, x, y);
-    if (cell != NULL) ll_enqueue(neighbors, cell);
+/**
+ * Get the ids of the neighbors of a cell, without allocating anything.
+ */
+const uint8_t* pz_get_neighbor_ids(Puzzle* pz, PuzzleCell* cell, int* count) {
+  *count = pz->neighbor_start[cell->id + 1] - pz->neighbor_start[cell->id];
+  return &pz->neighbors[pz->neighbor_start[cell->id]];
+}
+
+/**
+ * Bitmasks of the letters a word can use when entering or leaving a cell.
+ */
+uint32_t pz_cell_first_letters(PuzzleCell* cell) {
+  int c1 = dict_letter(cell->c1);
+  int c2 = dict_letter(cell->c2);
+  uint32_t letters = (c1 >= 0) ? (1u << c1) : 0;
+  if (cell->type == 2 && c2 >= 0) letters |= (1u << c2);
+  return letters;
+}
+uint32_t pz_cell_last_letters(PuzzleCell* cell) {
+  if (cell->type == 1) {
+    int c2 = dict_letter(cell->c2);
+    return (c2 >= 0) ? (1u << c2) : 0;
+  }
+  return pz_cell_first_letters(cell);
+}
+
+/**
+ * Describe which words can possibly be formed in a puzzle: how often every
+ * letter occurs, and which letters occur next to each other.
+ * Either/or cells count for both of their letters.
+ */
+void pz_build_filter(Puzzle* pz, DictionaryFilter* filter) {
+  memset(filter, 0, sizeof(DictionaryFilter));
+  for (int i = 0; i < pz->size * pz->size; i++) {
+    PuzzleCell* cell = pz_get_cell(pz, i);
+    int c1 = dict_letter(cell->c1);
+    int c2 = dict_letter(cell->c2);
+    if (c1 >= 0 && filter->counts[c1] < DICT_MAX_COUNT) filter->counts[c1]++;
+    if (cell->type != 0 && c2 >= 0 && filter->counts[c2] < DICT_MAX_COUNT) filter->counts[c2]++;
+    if (cell->type == 1 && c1 >= 0 && c2 >= 0) filter->bigrams[c1] |= (1u << c2);
+
+    uint32_t last = pz_cell_last_letters(cell);
+    int count;
+    const uint8_t* ids = pz_get_neighbor_ids(pz, cell, &count);
+    for (int n = 0; n < count; n++) {
+      uint32_t next = pz_cell_first_letters(&pz->cells[ids[n]]);
+      for (int letter = 0; letter < DICT_LETTERS; letter++) {
+        if (last & (1u << letter)) filter->bigrams[letter] |= next;
+      }
+    }
+  }
+}
+
+/**
+ * Mark all strings of a given length that can start a word in a puzzle.
+ * Strings are numbered in base 26, with 'a' being 0.
+ */
+void pz_mark_prefixes(Puzzle* pz, int length, uint8_t* marks) {
+  char* visited = calloc(pz->size * pz->size, sizeof(char));
+  for (int i = 0; i < pz->size * pz->size; i++) {
+    pz_mark_prefixes_from(pz, pz_get_cell(pz, i), length, 0, 0, visited, marks);
   }
-  return neighbors;
+  free(visited);
+}
+void pz_mark_prefixes_from(Puzzle* pz, PuzzleCell* cell, int length, int depth, int key, char* visited, uint8_t* marks) {
+  char options[2][2] = {{cell->c1, cell->c2}, {cell->c2, '\0'}};
+  int count = (cell->type == 2) ? 2 : 1;
+  if (cell->type != 1) options[0][1] = '\0';
+  visited[cell->id] = 1;
+  for (int o = 0; o < count; o++) {
+    int d = depth;
+    int k = key;
+    for (int i = 0; i < 2 && options[o][i] != '\0' && d < length && k >= 0; i++) {
+      int letter = dict_letter(options[o][i]);
+      k = (letter < 0) ? -1 : k * 26 + letter;
+      d++;
+    }
+    if (k < 0) continue;
+    if (d == length) {
+      marks[k] = 1;
+      continue;
+    }
+    int count;
+    const uint8_t* ids = pz_get_neighbor_ids(pz, cell, &count);
+    for (int n = 0; n < count; n++) {
+      if (!visited[ids[n]]) pz_mark_prefixes_from(pz, &pz->cells[ids[n]], length, d, k, visited, marks);
+    }
+  }
+  visited[cell->id] = 0;
 }
 
 int pz_xy_to_id(Puzzle* pz, int x, int y) {
@@ -115,71 +247,112 @@ int pz_cell_y(Puzzle* pz, PuzzleCell* cell) {
 
 /**
  * Get all possible new paths when adding a new cell to a given path.
+ * Paths that cannot lead to a word in the dictionary are left out.
  */
-LinkedList pz_add_cell_to_path(PuzzlePath* path, PuzzleCell* cell) {
+LinkedList pz_add_cell_to_path(PuzzlePath* path, PuzzleCell* cell, const Dictionary* dict) {
   LinkedList results = ll_create();
-  if (pz_path_contains_cell(path, cell)) return results;
-  PuzzlePath* new_path = pz_copy_path(path);
-  ll_enqueue(results, new_path);
-  ll_enqueue(new_path->cells, cell);
-  ll_enqueue(new_path->word, box_char(cell->c1));
+  if (!pz_path_can_add_cell(path, cell)) return results;
 
-  if (cell->type == 1) {
-    ll_enqueue(new_path->word, box_char(cell->c2));
-  } else if (cell->type == 2) {
-    new_path = pz_copy_path(path);
-    ll_enqueue(results, new_path);
-    ll_enqueue(new_path->cells, cell);
-    ll_enqueue(new_path->word, box_char(cell->c2));
+  uint32_t node = dict_child(dict, path->node, cell->c1);
+  if (cell->type == 1) node = dict_child(dict, node, cell->c2);
+  if (node != DICT_NO_NODE) {
+    ll_enqueue(results, pz_extend_path(path, cell, cell->c1, (cell->type == 1) ? cell->c2 : '\0', node));
+  }
+
+  if (cell->type == 2) {
+    node = dict_child(dict, path->node, cell->c2);
+    if (node != DICT_NO_NODE) {
+      ll_enqueue(results, pz_extend_path(path, cell, cell->c2, '\0', node));
+    }
   }
 
   return results;
 }
 
+/**
+ * Copy a path and add a cell with one or two letters to the copy.
+ */
+PuzzlePath* pz_extend_path(PuzzlePath* path, PuzzleCell* cell, char c1, char c2, uint32_t node) {
+  PuzzlePath* new_path = pz_copy_path(path);
+  pz_push_cell(new_path, cell, c1, c2, node);
+  return new_path;
+}
+
+/**
+ * Add a cell with one or two letters to a path in place.
+ * Undo it with pz_pop_cell, passing the number of letters and previous node.
+ */
+void pz_push_cell(PuzzlePath* path, PuzzleCell* cell, char c1, char c2, uint32_t node) {
+  path->cells[path->cell_count++] = cell->id;
+  path->visited |= PZ_MASK_BIT(cell->id);
+  path->word[path->length++] = c1;
+  if (c2 != '\0') path->word[path->length++] = c2;
+  path->word[path->length] = '\0';
+  path->node = node;
+}
+
+void pz_pop_cell(PuzzlePath* path, int letters, uint32_t node) {
+  path->cell_count--;
+  path->visited &= ~PZ_MASK_BIT(path->cells[path->cell_count]);
+  path->length -= letters;
+  path->word[path->length] = '\0';
+  path->node = node;
+}
+
+/**
+ * Check whether a cell is unused by a path, and the path has room for it.
+ */
+int pz_path_can_add_cell(PuzzlePath* path, PuzzleCell* cell) {
+  return !pz_path_contains_cell(path, cell) && path->cell_count < PZ_MAX_PATH
+    && path->length + 2 <= DICT_MAX_WORD_LENGTH;
+}
+
 int pz_path_contains_cell(PuzzlePath* path, PuzzleCell* cell) {
-  return ll_contains_data(path->cells, cell, pz_compare_cells);
+  return (path->visited & PZ_MASK_BIT(cell->id)) != 0;
 }
 
-int pz_compare_cells(void* data1, void* data2) {
-  PuzzleCell* cell1 = (PuzzleCell*) data1;
-  PuzzleCell* cell2 = (PuzzleCell*) data2;
-  return (cell1->id != cell2->id);
+PuzzleCell* pz_path_last_cell(Puzzle* pz, const PuzzlePath* path) {
+  if (path->cell_count == 0) return NULL;
+  return pz_get_cell(pz, path->cells[path->cell_count - 1]);
 }
 
-char* pz_path_to_word(PuzzlePath* path) {
-  return pz_ll_collapse_word(path->word);
+/**
+ * Get the word formed by a path, valid as long as the path is.
+ */
+const char* pz_path_to_word(const PuzzlePath* path) {
+  return path->word;
 }
 
 int pz_compare_paths_length_desc(void* data1, void* data2) {
   PuzzlePath* path1 = (PuzzlePath*) data1;
   PuzzlePath* path2 = (PuzzlePath*) data2;
-  return ll_size(path1->word) < ll_size(path2->word);
+  return path1->length < path2->length;
 }
 int pz_compare_paths_length_asc(void* data1, void* data2) {
   return (!pz_compare_paths_length_desc(data1, data2));
 }
 
-/**
- * Collapse a linked list of characters into an array of characters.
- */
-char* pz_ll_collapse_word(LinkedList word) {
-  int size = ll_size(word) + 1;
-  char* string = calloc(size, sizeof(char));
-  ll_iterate(word, pz_ll_collapse_word_callback, (void*) string);
-  string[size - 1] = '\0';
-  return string;
-}
-void pz_ll_collapse_word_callback(int idx, void* data, void* params) {
-  ((char*) params)[idx] = unbox_char(data);
-}
-
-PuzzleResults* pz_build_results_from_list(LinkedList results_list) {
+PuzzleResults* pz_create_results() {
   PuzzleResults* results = (PuzzleResults*) malloc(sizeof(PuzzleResults));
-  results->size = ll_size(results_list);
-  results->paths = (PuzzlePath**) ll_to_array(results_list);
+  results->size = 0;
+  results->capacity = 64;
+  results->paths = malloc(results->capacity * sizeof(PuzzlePath*));
   return results;
 }
 
+/**
+ * Add a copy of a path to the results. Not thread safe.
+ */
+void pz_add_result(PuzzleResults* results, const PuzzlePath* path) {
+  if (results->size == results->capacity) {
+    results->capacity *= 2;
+    results->paths = realloc(results->paths, results->capacity * sizeof(PuzzlePath*));
+  }
+  PuzzlePath* copy = malloc(sizeof(PuzzlePath));
+  *copy = *path;
+  results->paths[results->size++] = copy;
+}
+
 void pz_destroy_results(PuzzleResults* results) {
   free(results->paths);
   free(results);
@@ -187,7 +360,7 @@ void pz_destroy_results(PuzzleResults* results) {
 
 void pz_destroy_results_data(PuzzleResults* results) {
   for (int i = 0; i < results->size; i++) {
-    pz_destroy_path(results->paths[i]);
+    free(results->paths[i]);
   }
   pz_destroy_results(results);
 }
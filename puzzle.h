@@ -1,5 +1,6 @@
 #include "linkedlist.h"
 #include "box.h"
+#include "dictionary.h"
 
 #ifndef PUZZLE
 #define PUZZLE
@@ -14,23 +15,72 @@ struct PuzzleCell {
 };
 
 // Datastructure for an entire wordament puzzle instance.
+// The cells are stored next to each other in a single array. The ids of the
+// neighbors of cell i are neighbors[neighbor_start[i]] up to, but not
+// including, neighbors[neighbor_start[i + 1]]. They are computed once.
 typedef struct Puzzle Puzzle;
 struct Puzzle {
   int size;
-  PuzzleCell** cells;
+  PuzzleCell* cells;
+  uint16_t* neighbor_start;
+  uint8_t* neighbors;
 };
 
-// Datastructure for a path through a wordament puzzle.
+// Largest puzzle size supported, override with -DPZ_MAX_SIZE=<size>.
+// Every cell of a puzzle has a bit in the visited mask of a path,
+// so the mask is only as wide as the largest puzzle needs.
+// The default of 10 costs every path a 128-bit mask and room for 64 cells,
+// about 180 instead of 100 bytes. Building with -DPZ_MAX_SIZE=4 gives the
+// compact paths, but only 4x4 puzzles. The 4x4 kernel keeps its own small
+// state and only copies paths for words found and tasks split off,
+// so it runs about as fast either way.
+#ifndef PZ_MAX_SIZE
+#define PZ_MAX_SIZE 10
+#endif
+#if PZ_MAX_SIZE <= 4
+typedef uint16_t PuzzleMask;
+#elif PZ_MAX_SIZE <= 8
+typedef uint64_t PuzzleMask;
+#elif PZ_MAX_SIZE <= 11
+typedef unsigned __int128 PuzzleMask;
+#else
+#error "PZ_MAX_SIZE larger than 11 is not supported"
+#endif
+#define PZ_MASK_BIT(id) ((PuzzleMask) 1 << (id))
+
+// Maximum number of cells next to a cell.
+#define PZ_NEIGHBORS 8
+
+// Maximum number of cells in a path: every cell adds at least one letter,
+// so a path can never be longer than the longest word.
+#define PZ_MAX_CELLS (PZ_MAX_SIZE * PZ_MAX_SIZE)
+#define PZ_MAX_PATH ((PZ_MAX_CELLS < DICT_MAX_WORD_LENGTH) ? PZ_MAX_CELLS : DICT_MAX_WORD_LENGTH)
+
+// Datastructure for a path through a wordament puzzle, stored inline,
+// so it is copied at once. Bit i of visited is set when cell i is used.
+// The dictionary node of the word formed so far is carried along,
+// so extending a path never has to look up the whole word again.
 typedef struct PuzzlePath PuzzlePath;
 struct PuzzlePath {
-  LinkedList cells;
-  LinkedList word;
+  uint8_t cells[PZ_MAX_PATH];
+  char word[DICT_MAX_WORD_LENGTH + 1];
+  int cell_count;
+  int length;
+  PuzzleMask visited;
+  uint32_t node;
 };
 
+// Reuse of paths by the pools of all threads.
+extern PoolStats pz_pool_stats;
+
 // Datastructure for a solution to the puzzle.
+// Its paths are copied to the heap instead of taken from a pool: they are
+// created by the searching threads and freed by another, so no pool would
+// ever get them back.
 typedef struct PuzzleResults PuzzleResults;
 struct PuzzleResults {
   int size;
+  int capacity;
   PuzzlePath** paths;
 };
 
@@ -41,8 +91,11 @@ PuzzleCell* pz_create_cell(int id, int type, char c1, char c2);
 void pz_destroy_cell(PuzzleCell* cell);
 
 PuzzlePath* pz_create_path();
+void pz_init_path(PuzzlePath* path);
 void pz_destroy_path(PuzzlePath*);
-PuzzlePath* pz_copy_path(PuzzlePath*);
+PuzzlePath* pz_copy_path(const PuzzlePath*);
+void pz_pool_flush();
+void pz_pool_drain();
 
 void pz_ll_destroy_cell(void* data);
 void pz_ll_destroy_path(void* data);
@@ -50,25 +103,33 @@ void pz_ll_destroy_path(void* data);
 void pz_add_cell(Puzzle* pz, PuzzleCell* cell);
 PuzzleCell* pz_get_cell(Puzzle* pz, int id);
 PuzzleCell* pz_get_cell_xy(Puzzle* pz, int x, int y);
-LinkedList pz_get_cell_neighbors(Puzzle* pz, PuzzleCell* cell);
+const uint8_t* pz_get_neighbor_ids(Puzzle* pz, PuzzleCell* cell, int* count);
 int pz_valid_cell_id(Puzzle* pz, int id);
 int pz_valid_cell_xy(Puzzle* pz, int x, int y);
 int pz_xy_to_id(Puzzle* pz, int x, int y);
 int pz_cell_x(Puzzle* pz, PuzzleCell* cell);
 int pz_cell_y(Puzzle* pz, PuzzleCell* cell);
+uint32_t pz_cell_first_letters(PuzzleCell* cell);
+uint32_t pz_cell_last_letters(PuzzleCell* cell);
+void pz_build_filter(Puzzle* pz, DictionaryFilter* filter);
+void pz_mark_prefixes(Puzzle* pz, int length, uint8_t* marks);
+void pz_mark_prefixes_from(Puzzle* pz, PuzzleCell* cell, int length, int depth, int key, char* visited, uint8_t* marks);
 
-LinkedList pz_add_cell_to_path(PuzzlePath* path, PuzzleCell* cell);
+PuzzlePath* pz_extend_path(PuzzlePath* path, PuzzleCell* cell, char c1, char c2, uint32_t node);
+void pz_push_cell(PuzzlePath* path, PuzzleCell* cell, char c1, char c2, uint32_t node);
+void pz_pop_cell(PuzzlePath* path, int letters, uint32_t node);
+LinkedList pz_add_cell_to_path(PuzzlePath* path, PuzzleCell* cell, const Dictionary* dict);
+int pz_path_can_add_cell(PuzzlePath* path, PuzzleCell* cell);
 int pz_path_contains_cell(PuzzlePath* path, PuzzleCell* cell);
-int pz_compare_cells(void* data1, void* data2);
-char* pz_path_to_word(PuzzlePath* path);
+const char* pz_path_to_word(const PuzzlePath* path);
+PuzzleCell* pz_path_last_cell(Puzzle* pz, const PuzzlePath* path);
 
 int pz_compare_paths_length_desc(void* data1, void* data2);
 int pz_compare_paths_length_asc(void* data1, void* data2);
 
-char* pz_ll_collapse_word(LinkedList word);
-void pz_ll_collapse_word_callback(int idx, void* data, void* params);
 
-PuzzleResults* pz_build_results_from_list(LinkedList results_list);
+PuzzleResults* pz_create_results();
+void pz_add_result(PuzzleResults* results, const PuzzlePath* path);
 void pz_destroy_results(PuzzleResults* results);
 void pz_destroy_results_data(PuzzleResults* results);
 
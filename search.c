@@ -0,0 +1,298 @@
+#include "search.h"
+
+void search_run_task(void* task);
+void search_spawn(const Search* search, const PuzzlePath* path, int cell_id);
+void search_generic_next(const Search* search, PuzzlePath* path);
+void search_generic_visit(const Search* search, PuzzlePath* path, PuzzleCell* cell);
+void search_generic_step(const Search* search, PuzzlePath* path, PuzzleCell* cell, char c1, char c2, uint32_t node);
+void search_build_path(PuzzlePath* path, const uint8_t* cells, int count, const char* word, int length, uint32_t node);
+void search_report(const Search* search, const uint8_t* cells, int count, const char* word, int length, uint32_t node);
+
+// Split tasks are freed by the worker running them, often not the one
+// creating them, so each worker only keeps a few of them.
+PoolStats search_task_stats;
+__thread Pool search_task_pool = {sizeof(SearchTask), &search_task_stats, SEARCH_MAX_FREE_TASKS, NULL, 0, 0, 0};
+
+/**
+ * Find all words in a puzzle with the workers of the thread pool of a search.
+ * Every start cell is a task, which is split further while searching.
+ * The tasks for the start cells live in one array freed once all are done.
+ */
+void search_parallel(const Search* search) {
+  int cells = search->puzzle->size * search->puzzle->size;
+  SearchTask* roots = malloc(cells * sizeof(SearchTask));
+  void* tasks[cells];
+  PuzzlePath path;
+  pz_init_path(&path);
+  for (int i = 0; i < cells; i++) {
+    roots[i].search = search;
+    roots[i].cell = i;
+    roots[i].pooled = 0;
+    roots[i].path = path;
+    tasks[i] = &roots[i];
+  }
+  tp_run(search->pool, search_run_task, tasks, cells);
+  free(roots);
+}
+
+void search_run_task(void* data) {
+  SearchTask* task = (SearchTask*) data;
+  search_enter(task->search, &task->path, task->cell);
+  if (task->pooled) pool_free(&search_task_pool, task);
+}
+
+// Push a task for the words starting with a path followed by a cell.
+void search_spawn(const Search* search, const PuzzlePath* path, int cell_id) {
+  SearchTask* task = pool_alloc(&search_task_pool);
+  task->search = search;
+  task->cell = cell_id;
+  task->pooled = 1;
+  task->path = *path;
+  tp_push(search->pool, task);
+}
+
+// Split paths into tasks up to SEARCH_SPLIT_DEPTH cells, and further
+// while workers have nothing to do. A single worker has no one to share with.
+static inline int search_should_split(const Search* search, int cell_count) {
+  if (search->pool == NULL || search->pool->size == 1) return 0;
+  if (cell_count < SEARCH_SPLIT_DEPTH) return 1;
+  return cell_count < SEARCH_MAX_SPLIT_DEPTH && __atomic_load_n(&search->pool->idle, __ATOMIC_RELAXED) > 0;
+}
+
+/**
+ * Add the reuse counts of the calling thread to the shared stats,
+ * keeping its objects for the next search.
+ * Every worker searching should call this when a search is done.
+ */
+void search_pool_flush() {
+  pool_flush(&search_task_pool);
+  pz_pool_flush();
+}
+
+/**
+ * Free the tasks kept for reuse by the calling thread, and its paths and lists.
+ * Every worker searching should call this before exiting.
+ */
+void search_pool_drain() {
+  pool_drain(&search_task_pool);
+  pz_pool_drain();
+}
+
+/**
+ * Find all words starting with a path followed by a cell, with the kernel
+ * specialized for the size of the puzzle if there is one.
+ */
+void search_enter(const Search* search, const PuzzlePath* path, int cell_id) {
+  if (search->puzzle->size == 4) {
+    search_4x4_enter(search, path, cell_id);
+  } else {
+    search_generic_enter(search, path, cell_id);
+  }
+}
+
+/**
+ * Find all words starting with a path followed by a cell depth-first,
+ * in a puzzle of any size. One path is extended and shrunk again in place,
+ * so memory stays bounded by the length of the longest word,
+ * and only found words are copied.
+ */
+void search_generic_enter(const Search* search, const PuzzlePath* path, int cell_id) {
+  PuzzlePath* copy = pz_copy_path(path);
+  search_generic_visit(search, copy, pz_get_cell(search->puzzle, cell_id));
+  pz_destroy_path(copy);
+}
+
+void search_generic_next(const Search* search, PuzzlePath* path) {
+  PuzzleCell* cell = pz_path_last_cell(search->puzzle, path);
+  int count;
+  const uint8_t* ids = pz_get_neighbor_ids(search->puzzle, cell, &count);
+  if (search_should_split(search, path->cell_count)) {
+    for (int i = 0; i < count; i++) {
+      if (!(path->visited & PZ_MASK_BIT(ids[i]))) search_spawn(search, path, ids[i]);
+    }
+    return;
+  }
+  for (int i = 0; i < count; i++) {
+    search_generic_visit(search, path, &search->puzzle->cells[ids[i]]);
+  }
+}
+
+// Either/or cells are entered once for each of their letters.
+void search_generic_visit(const Search* search, PuzzlePath* path, PuzzleCell* cell) {
+  if (!pz_path_can_add_cell(path, cell)) return;
+  uint32_t node = dict_child(search->dict, path->node, cell->c1);
+  if (cell->type == 1) {
+    search_generic_step(search, path, cell, cell->c1, cell->c2, dict_child(search->dict, node, cell->c2));
+  } else {
+    search_generic_step(search, path, cell, cell->c1, '\0', node);
+  }
+  if (cell->type == 2) {
+    search_generic_step(search, path, cell, cell->c2, '\0', dict_child(search->dict, path->node, cell->c2));
+  }
+}
+
+void search_generic_step(const Search* search, PuzzlePath* path, PuzzleCell* cell, char c1, char c2, uint32_t node) {
+  int status = dict_node_status(search->dict, node);
+  if (status == DICT_NONE) return;
+  uint32_t parent = path->node;
+  pz_push_cell(path, cell, c1, c2, node);
+  if (status == DICT_WORD && path->length >= search->min_length && dict_mark(search->marks, node)) {
+    search->found(path, search->data);
+  }
+  search_generic_next(search, path);
+  pz_pop_cell(path, (c2 != '\0') ? 2 : 1, parent);
+}
+
+/**
+ * Build a path from the cells and letters of a kernel.
+ */
+void search_build_path(PuzzlePath* path, const uint8_t* cells, int count, const char* word, int length, uint32_t node) {
+  path->cell_count = count;
+  path->length = length;
+  path->visited = 0;
+  path->node = node;
+  for (int i = 0; i < count; i++) {
+    path->cells[i] = cells[i];
+    path->visited |= PZ_MASK_BIT(cells[i]);
+  }
+  memcpy(path->word, word, length);
+  path->word[length] = '\0';
+}
+
+/**
+ * Report a word found by a kernel as a path.
+ */
+void search_report(const Search* search, const uint8_t* cells, int count, const char* word, int length, uint32_t node) {
+  PuzzlePath path;
+  search_build_path(&path, cells, count, word, length, node);
+  search->found(&path, search->data);
+}
+
+// Step from a trie node to its child for a letter, like dict_child,
+// but inlined into the kernels.
+static inline uint32_t search_child(const DictionaryNode* nodes, uint32_t node, int letter) {
+  if (node == DICT_NO_NODE || letter < 0) return DICT_NO_NODE;
+  uint32_t bit = 1u << letter;
+  if (!(nodes[node].children & bit)) return DICT_NO_NODE;
+  return nodes[node].first + __builtin_popcount(nodes[node].children & (bit - 1));
+}
+
+// Bit of the cell at x, y in a puzzle of size n, or 0 if it lies outside.
+#define SEARCH_CELL_BIT(n, x, y)                                               \
+  ((0 <= (x) && (x) < (n) && 0 <= (y) && (y) < (n)) ? 1u << ((x) + (y) * (n)) : 0u)
+
+// Bitmask of the neighbors of a cell in a puzzle of size n, a constant.
+#define SEARCH_NEIGHBORS(n, id)                                                \
+  (SEARCH_CELL_BIT(n, (id) % (n) - 1, (id) / (n) - 1)                          \
+   | SEARCH_CELL_BIT(n, (id) % (n), (id) / (n) - 1)                            \
+   | SEARCH_CELL_BIT(n, (id) % (n) + 1, (id) / (n) - 1)                        \
+   | SEARCH_CELL_BIT(n, (id) % (n) + 1, (id) / (n))                            \
+   | SEARCH_CELL_BIT(n, (id) % (n) + 1, (id) / (n) + 1)                        \
+   | SEARCH_CELL_BIT(n, (id) % (n), (id) / (n) + 1)                            \
+   | SEARCH_CELL_BIT(n, (id) % (n) - 1, (id) / (n) + 1)                        \
+   | SEARCH_CELL_BIT(n, (id) % (n) - 1, (id) / (n)))
+
+#define SEARCH_NEIGHBORS_4X4                                                   \
+  SEARCH_NEIGHBORS(4, 0), SEARCH_NEIGHBORS(4, 1), SEARCH_NEIGHBORS(4, 2),      \
+  SEARCH_NEIGHBORS(4, 3), SEARCH_NEIGHBORS(4, 4), SEARCH_NEIGHBORS(4, 5),      \
+  SEARCH_NEIGHBORS(4, 6), SEARCH_NEIGHBORS(4, 7), SEARCH_NEIGHBORS(4, 8),      \
+  SEARCH_NEIGHBORS(4, 9), SEARCH_NEIGHBORS(4, 10), SEARCH_NEIGHBORS(4, 11),    \
+  SEARCH_NEIGHBORS(4, 12), SEARCH_NEIGHBORS(4, 13), SEARCH_NEIGHBORS(4, 14),   \
+  SEARCH_NEIGHBORS(4, 15)
+
+// Define a depth-first search kernel for puzzles of size n, as name_enter.
+// The neighbors of every cell are a constant bitmask, so the unvisited ones
+// are found with a single AND, and the path is kept in fixed size buffers
+// holding the most cells and letters a path in such a puzzle can have.
+// The trie is walked directly, the puzzle is only read once per search.
+// Puzzles of up to 32 cells are supported, with a mask_type that fits them.
+#define DEFINE_SEARCH_KERNEL(name, n, mask_type, neighbors)                    \
+static const mask_type name##_neighbors[(n) * (n)] = {neighbors};              \
+                                                                               \
+typedef struct name##State name##State;                                        \
+struct name##State {                                                           \
+  const Search* search;                                                        \
+  const DictionaryNode* nodes;                                                 \
+  int8_t types[(n) * (n)];                                                     \
+  int8_t letters[(n) * (n)][2];                                                \
+  char chars[(n) * (n)][2];                                                    \
+  uint8_t cells[(n) * (n)];                                                    \
+  char word[2 * (n) * (n) + 1];                                                \
+};                                                                             \
+                                                                               \
+static void name##_visit(name##State* state, int id, uint32_t node,            \
+                         mask_type visited, int depth, int length);            \
+                                                                               \
+static void name##_step(name##State* state, int id, uint32_t node,             \
+                        mask_type visited, int depth, int length) {            \
+  if (node == DICT_NO_NODE) return;                                            \
+  uint32_t children = state->nodes[node].children;                             \
+  if ((children & DICT_TERMINAL) && length >= state->search->min_length        \
+      && dict_mark(state->search->marks, node)) {                              \
+    search_report(state->search, state->cells, depth + 1, state->word,         \
+                  length, node);                                               \
+  }                                                                            \
+  if (!(children & ~DICT_TERMINAL)) return;                                    \
+  mask_type next = name##_neighbors[id] & ~visited;                            \
+  if (search_should_split(state->search, depth + 1)) {                         \
+    PuzzlePath path;                                                           \
+    search_build_path(&path, state->cells, depth + 1, state->word, length,     \
+                      node);                                                   \
+    while (next) {                                                             \
+      search_spawn(state->search, &path, __builtin_ctz(next));                 \
+      next &= next - 1;                                                        \
+    }                                                                          \
+    return;                                                                    \
+  }                                                                            \
+  while (next) {                                                               \
+    int nb = __builtin_ctz(next);                                              \
+    next &= next - 1;                                                          \
+    name##_visit(state, nb, node, visited | (mask_type) (1u << nb),            \
+                 depth + 1, length);                                           \
+  }                                                                            \
+}                                                                              \
+                                                                               \
+static void name##_visit(name##State* state, int id, uint32_t node,            \
+                         mask_type visited, int depth, int length) {           \
+  const int8_t* letters = state->letters[id];                                  \
+  const char* chars = state->chars[id];                                        \
+  state->cells[depth] = id;                                                    \
+  state->word[length] = chars[0];                                              \
+  uint32_t child = search_child(state->nodes, node, letters[0]);               \
+  if (state->types[id] == 1) {                                                 \
+    state->word[length + 1] = chars[1];                                        \
+    child = search_child(state->nodes, child, letters[1]);                     \
+    name##_step(state, id, child, visited, depth, length + 2);                 \
+    return;                                                                    \
+  }                                                                            \
+  name##_step(state, id, child, visited, depth, length + 1);                   \
+  if (state->types[id] == 2) {                                                 \
+    state->word[length] = chars[1];                                            \
+    child = search_child(state->nodes, node, letters[1]);                      \
+    name##_step(state, id, child, visited, depth, length + 1);                 \
+  }                                                                            \
+}                                                                              \
+                                                                               \
+void name##_enter(const Search* search, const PuzzlePath* path, int cell_id) { \
+  name##State state;                                                           \
+  state.search = search;                                                       \
+  state.nodes = search->dict->nodes;                                           \
+  for (int i = 0; i < (n) * (n); i++) {                                        \
+    PuzzleCell* cell = pz_get_cell(search->puzzle, i);                         \
+    state.types[i] = cell->type;                                               \
+    state.letters[i][0] = dict_letter(cell->c1);                               \
+    state.letters[i][1] = dict_letter(cell->c2);                               \
+    state.chars[i][0] = cell->c1;                                              \
+    state.chars[i][1] = cell->c2;                                              \
+  }                                                                            \
+  mask_type visited = (mask_type) (1u << cell_id);                             \
+  for (int i = 0; i < path->cell_count; i++) {                                 \
+    state.cells[i] = path->cells[i];                                           \
+    visited |= (mask_type) (1u << path->cells[i]);                             \
+  }                                                                            \
+  memcpy(state.word, path->word, path->length);                                \
+  name##_visit(&state, cell_id, path->node, visited, path->cell_count,         \
+               path->length);                                                  \
+}
+
+DEFINE_SEARCH_KERNEL(search_4x4, 4, uint16_t, SEARCH_NEIGHBORS_4X4)
@@ -0,0 +1,56 @@
+#include "puzzle.h"
+#include "dictionary.h"
+#include "threadpool.h"
+
+#ifndef SEARCH
+#define SEARCH
+
+// Paths with fewer cells are always split into a task per next cell, paths
+// up to the maximum only while workers of the thread pool are idle.
+#define SEARCH_SPLIT_DEPTH 2
+#define SEARCH_MAX_SPLIT_DEPTH 6
+
+// Maximum number of split tasks a worker keeps for reuse.
+#define SEARCH_MAX_FREE_TASKS 1024
+
+// Called for every word found, with a path that is only valid during the call.
+typedef void (*SearchFoundCallback)(PuzzlePath* path, void* data);
+
+// Datastructure for a depth-first search of a puzzle: what is searched,
+// and what is done with the words found. Every word is reported once,
+// by the first path that marks its dictionary node.
+// With a thread pool, the search is split into tasks run by its workers,
+// and the callback is called from these.
+typedef struct Search Search;
+struct Search {
+  Puzzle* puzzle;
+  const Dictionary* dict;
+  DictionaryMarks* marks;
+  int min_length;
+  SearchFoundCallback found;
+  void* data;
+  ThreadPool* pool;
+};
+
+// Datastructure for a part of a search: all words starting with a path
+// followed by a cell. Only split tasks come from a pool, the tasks for
+// the start cells are owned by the search that creates them.
+typedef struct SearchTask SearchTask;
+struct SearchTask {
+  const Search* search;
+  int cell;
+  int pooled;
+  PuzzlePath path;
+};
+
+// Reuse of tasks by the pools of all threads.
+extern PoolStats search_task_stats;
+
+void search_parallel(const Search* search);
+void search_enter(const Search* search, const PuzzlePath* path, int cell_id);
+void search_generic_enter(const Search* search, const PuzzlePath* path, int cell_id);
+void search_4x4_enter(const Search* search, const PuzzlePath* path, int cell_id);
+void search_pool_flush();
+void search_pool_drain();
+
+#endif
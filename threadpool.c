@@ -0,0 +1,279 @@
+#include <sched.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "threadpool.h"
+
+// Number of times an idle worker yields before it sleeps until a task is pushed.
+#define TP_SPINS 16
+
+// Index of the worker running on this thread, or -1 for other threads.
+__thread int tp_worker = -1;
+
+// Declare struct to be used for passing parameters to a worker thread.
+typedef struct {
+  ThreadPool* pool;
+  int index;
+} ThreadPoolWorker;
+
+void* tp_work(void* params);
+void tp_work_batch(ThreadPool* pool, int index);
+void tp_sleep(ThreadPool* pool);
+int tp_has_tasks(ThreadPool* pool);
+ThreadPoolDeque* tp_deque_create();
+void tp_deque_destroy(ThreadPoolDeque* deque);
+void tp_deque_push(ThreadPoolDeque* deque, void* task);
+void* tp_deque_pop(ThreadPoolDeque* deque);
+void* tp_deque_steal(ThreadPoolDeque* deque);
+
+/**
+ * Create a pool of a number of workers, which wait for tasks until the pool
+ * is destroyed. Every worker calls at_batch, if given, when it is done with
+ * a batch, and at_exit, if given, before it exits.
+ */
+ThreadPool* tp_create(int size, void (*at_batch)(), void (*at_exit)()) {
+  if (size < 1) size = 1;
+  ThreadPool* pool = malloc(sizeof(ThreadPool));
+  pool->size = size;
+  pool->threads = malloc(size * sizeof(pthread_t));
+  pool->deques = malloc(size * sizeof(ThreadPoolDeque*));
+  pool->run = NULL;
+  pool->at_batch = at_batch;
+  pool->at_exit = at_exit;
+  pool->pending = 0;
+  pool->idle = 0;
+  pool->sleeping = 0;
+  pool->active = 0;
+  pool->next = 0;
+  pool->generation = 0;
+  pool->stop = 0;
+  pthread_mutex_init(&pool->lock, NULL);
+  pthread_cond_init(&pool->work, NULL);
+  pthread_cond_init(&pool->done, NULL);
+  for (int i = 0; i < size; i++) {
+    pool->deques[i] = tp_deque_create();
+  }
+  for (int i = 0; i < size; i++) {
+    ThreadPoolWorker* worker = malloc(sizeof(ThreadPoolWorker));
+    worker->pool = pool;
+    worker->index = i;
+    if (pthread_create(&pool->threads[i], NULL, tp_work, worker)) {
+      printf("Error: failed to create worker thread %i.\n", i);
+      exit(1);
+    }
+  }
+  return pool;
+}
+
+void tp_destroy(ThreadPool* pool) {
+  pthread_mutex_lock(&pool->lock);
+  pool->stop = 1;
+  pthread_cond_broadcast(&pool->work);
+  pthread_mutex_unlock(&pool->lock);
+  for (int i = 0; i < pool->size; i++) {
+    if (pthread_join(pool->threads[i], NULL)) {
+      printf("Error: failed to join worker thread %i.\n", i);
+      exit(2);
+    }
+    tp_deque_destroy(pool->deques[i]);
+  }
+  pthread_cond_destroy(&pool->done);
+  pthread_cond_destroy(&pool->work);
+  pthread_mutex_destroy(&pool->lock);
+  free(pool->deques);
+  free(pool->threads);
+  free(pool);
+}
+
+/**
+ * Run a function for a batch of tasks, and for all tasks they push,
+ * returning once every one of them is finished and every worker that took
+ * part has called at_batch. The tasks are spread over the workers.
+ * Only one batch runs at a time.
+ */
+void tp_run(ThreadPool* pool, ThreadPoolFunction run, void** tasks, int count) {
+  if (count == 0) return;
+  pool->run = run;
+  for (int i = 0; i < count; i++) {
+    tp_push(pool, tasks[i]);
+  }
+  pthread_mutex_lock(&pool->lock);
+  pool->generation++;
+  pthread_cond_broadcast(&pool->work);
+  while (__atomic_load_n(&pool->pending, __ATOMIC_ACQUIRE) > 0 || pool->active > 0) {
+    pthread_cond_wait(&pool->done, &pool->lock);
+  }
+  pthread_mutex_unlock(&pool->lock);
+}
+
+/**
+ * Push a task. A worker pushes to its own deque, where it runs the task
+ * next unless another worker steals it first. Sleeping workers are woken.
+ */
+void tp_push(ThreadPool* pool, void* task) {
+  int index = tp_worker;
+  if (index < 0 || index >= pool->size) {
+    index = pool->next;
+    pool->next = (pool->next + 1) % pool->size;
+  }
+  __atomic_add_fetch(&pool->pending, 1, __ATOMIC_ACQ_REL);
+  tp_deque_push(pool->deques[index], task);
+  // The deque counts and the number of sleeping workers are sequentially
+  // consistent, so either a worker going to sleep sees the task,
+  // or it is seen sleeping here.
+  if (__atomic_load_n(&pool->sleeping, __ATOMIC_SEQ_CST) > 0) {
+    pthread_mutex_lock(&pool->lock);
+    pthread_cond_broadcast(&pool->work);
+    pthread_mutex_unlock(&pool->lock);
+  }
+}
+
+/**
+ * Thread: wait for a batch, and work on it until it is finished.
+ */
+void* tp_work(void* params) {
+  ThreadPoolWorker* worker = (ThreadPoolWorker*) params;
+  ThreadPool* pool = worker->pool;
+  int index = worker->index;
+  free(worker);
+  tp_worker = index;
+
+  int generation = 0;
+  while (1) {
+    pthread_mutex_lock(&pool->lock);
+    while (!pool->stop && pool->generation == generation) {
+      pthread_cond_wait(&pool->work, &pool->lock);
+    }
+    generation = pool->generation;
+    int stop = pool->stop;
+    if (!stop) pool->active++;
+    pthread_mutex_unlock(&pool->lock);
+    if (stop) break;
+    tp_work_batch(pool, index);
+    if (pool->at_batch != NULL) pool->at_batch();
+
+    pthread_mutex_lock(&pool->lock);
+    if (--pool->active == 0) pthread_cond_broadcast(&pool->done);
+    pthread_mutex_unlock(&pool->lock);
+  }
+
+  if (pool->at_exit != NULL) pool->at_exit();
+  return NULL;
+}
+
+// Run the own tasks, newest first, and steal the oldest tasks of the other
+// workers when out of them. A worker without tasks keeps looking as long as
+// tasks are running elsewhere, since these may still push new ones:
+// it yields a few times, then sleeps until a task is pushed.
+void tp_work_batch(ThreadPool* pool, int index) {
+  int idle = 0;
+  int spins = 0;
+  while (__atomic_load_n(&pool->pending, __ATOMIC_ACQUIRE) > 0) {
+    void* task = tp_deque_pop(pool->deques[index]);
+    for (int i = 1; task == NULL && i < pool->size; i++) {
+      task = tp_deque_steal(pool->deques[(index + i) % pool->size]);
+    }
+    if (task == NULL) {
+      if (!idle) __atomic_add_fetch(&pool->idle, 1, __ATOMIC_RELAXED);
+      idle = 1;
+      if (spins++ < TP_SPINS) {
+        sched_yield();
+      } else {
+        tp_sleep(pool);
+        spins = 0;
+      }
+      continue;
+    }
+    if (idle) __atomic_sub_fetch(&pool->idle, 1, __ATOMIC_RELAXED);
+    idle = 0;
+    spins = 0;
+
+    pool->run(task);
+    if (__atomic_sub_fetch(&pool->pending, 1, __ATOMIC_ACQ_REL) == 0) {
+      pthread_mutex_lock(&pool->lock);
+      pthread_cond_broadcast(&pool->done);
+      pthread_cond_broadcast(&pool->work);
+      pthread_mutex_unlock(&pool->lock);
+    }
+  }
+  if (idle) __atomic_sub_fetch(&pool->idle, 1, __ATOMIC_RELAXED);
+}
+
+// Wait until a task is pushed or the batch is finished.
+// Wakeups for other reasons just send the worker looking again.
+void tp_sleep(ThreadPool* pool) {
+  pthread_mutex_lock(&pool->lock);
+  __atomic_add_fetch(&pool->sleeping, 1, __ATOMIC_SEQ_CST);
+  if (__atomic_load_n(&pool->pending, __ATOMIC_ACQUIRE) > 0 && !tp_has_tasks(pool)) {
+    pthread_cond_wait(&pool->work, &pool->lock);
+  }
+  __atomic_sub_fetch(&pool->sleeping, 1, __ATOMIC_RELAXED);
+  pthread_mutex_unlock(&pool->lock);
+}
+
+int tp_has_tasks(ThreadPool* pool) {
+  for (int i = 0; i < pool->size; i++) {
+    if (__atomic_load_n(&pool->deques[i]->count, __ATOMIC_SEQ_CST) > 0) return 1;
+  }
+  return 0;
+}
+
+ThreadPoolDeque* tp_deque_create() {
+  ThreadPoolDeque* deque = malloc(sizeof(ThreadPoolDeque));
+  pthread_mutex_init(&deque->lock, NULL);
+  deque->capacity = 64;
+  deque->tasks = malloc(deque->capacity * sizeof(void*));
+  deque->head = 0;
+  deque->count = 0;
+  return deque;
+}
+
+void tp_deque_destroy(ThreadPoolDeque* deque) {
+  pthread_mutex_destroy(&deque->lock);
+  free(deque->tasks);
+  free(deque);
+}
+
+void tp_deque_push(ThreadPoolDeque* deque, void* task) {
+  pthread_mutex_lock(&deque->lock);
+  if (deque->count == deque->capacity) {
+    // Unwrap the ring buffer into one twice as large.
+    void** tasks = malloc(2 * deque->capacity * sizeof(void*));
+    for (int i = 0; i < deque->count; i++) {
+      tasks[i] = deque->tasks[(deque->head + i) % deque->capacity];
+    }
+    free(deque->tasks);
+    deque->tasks = tasks;
+    deque->head = 0;
+    deque->capacity *= 2;
+  }
+  deque->tasks[(deque->head + deque->count) % deque->capacity] = task;
+  __atomic_store_n(&deque->count, deque->count + 1, __ATOMIC_SEQ_CST);
+  pthread_mutex_unlock(&deque->lock);
+}
+
+void* tp_deque_pop(ThreadPoolDeque* deque) {
+  if (__atomic_load_n(&deque->count, __ATOMIC_RELAXED) == 0) return NULL;
+  void* task = NULL;
+  pthread_mutex_lock(&deque->lock);
+  if (deque->count > 0) {
+    __atomic_store_n(&deque->count, deque->count - 1, __ATOMIC_RELAXED);
+    task = deque->tasks[(deque->head + deque->count) % deque->capacity];
+  }
+  pthread_mutex_unlock(&deque->lock);
+  return task;
+}
+
+// Empty deques are skipped without locking them.
+void* tp_deque_steal(ThreadPoolDeque* deque) {
+  if (__atomic_load_n(&deque->count, __ATOMIC_RELAXED) == 0) return NULL;
+  void* task = NULL;
+  pthread_mutex_lock(&deque->lock);
+  if (deque->count > 0) {
+    task = deque->tasks[deque->head];
+    deque->head = (deque->head + 1) % deque->capacity;
+    __atomic_store_n(&deque->count, deque->count - 1, __ATOMIC_RELAXED);
+  }
+  pthread_mutex_unlock(&deque->lock);
+  return task;
+}
@@ -0,0 +1,54 @@
+#include <pthread.h>
+#include <stdlib.h>
+
+#ifndef THREADPOOL
+#define THREADPOOL
+
+// Called by a worker for every task it runs.
+typedef void (*ThreadPoolFunction)(void* task);
+
+// Datastructure for the tasks of one worker, as a ring buffer.
+// The worker pushes and pops its newest tasks at the tail,
+// other workers steal the oldest ones at the head.
+typedef struct ThreadPoolDeque ThreadPoolDeque;
+struct ThreadPoolDeque {
+  pthread_mutex_t lock;
+  void** tasks;
+  int head;
+  int count;
+  int capacity;
+};
+
+// Datastructure for worker threads that live as long as the pool and run
+// batches of tasks, one worker per processor. Running tasks may push more
+// tasks, which other workers steal when they run out of their own.
+// pending counts the tasks pushed but not finished yet,
+// idle the workers that are looking for a task, sleeping those of them
+// waiting for work to be pushed, and active the workers that have not
+// finished the current batch.
+typedef struct ThreadPool ThreadPool;
+struct ThreadPool {
+  int size;
+  pthread_t* threads;
+  ThreadPoolDeque** deques;
+  ThreadPoolFunction run;
+  void (*at_batch)();
+  void (*at_exit)();
+  int pending;
+  int idle;
+  int sleeping;
+  int active;
+  int next;
+  int generation;
+  int stop;
+  pthread_mutex_t lock;
+  pthread_cond_t work;
+  pthread_cond_t done;
+};
+
+ThreadPool* tp_create(int size, void (*at_batch)(), void (*at_exit)());
+void tp_destroy(ThreadPool* pool);
+void tp_run(ThreadPool* pool, ThreadPoolFunction run, void** tasks, int count);
+void tp_push(ThreadPool* pool, void* task);
+
+#endif
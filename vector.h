@@ -0,0 +1,78 @@
+#include <stdlib.h>
+#include <string.h>
+
+#ifndef VECTOR
+#define VECTOR
+
+// Define a growable array of values of a type, stored inline instead of
+// boxed one by one, together with its functions, all starting with prefix.
+// A vector is usually embedded by value: initialize it with prefix_init.
+#define DEFINE_VECTOR(Name, prefix, type)                                      \
+typedef struct Name Name;                                                      \
+struct Name {                                                                  \
+  type* data;                                                                  \
+  int size;                                                                    \
+  int capacity;                                                                \
+};                                                                             \
+                                                                               \
+static inline void prefix##_init(Name* v) {                                    \
+  v->data = NULL;                                                              \
+  v->size = 0;                                                                 \
+  v->capacity = 0;                                                             \
+}                                                                              \
+                                                                               \
+static inline void prefix##_reserve(Name* v, int capacity) {                   \
+  if (capacity <= v->capacity) return;                                         \
+  if (capacity < 2 * v->capacity) capacity = 2 * v->capacity;                  \
+  if (capacity < 8) capacity = 8;                                              \
+  v->data = realloc(v->data, capacity * sizeof(type));                         \
+  v->capacity = capacity;                                                      \
+}                                                                              \
+                                                                               \
+static inline void prefix##_push(Name* v, type value) {                        \
+  if (v->size == v->capacity) prefix##_reserve(v, v->size + 1);                \
+  v->data[v->size++] = value;                                                  \
+}                                                                              \
+                                                                               \
+static inline type prefix##_pop(Name* v) {                                     \
+  return v->data[--v->size];                                                   \
+}                                                                              \
+                                                                               \
+static inline type prefix##_get(const Name* v, int i) {                        \
+  return v->data[i];                                                           \
+}                                                                              \
+                                                                               \
+static inline type prefix##_last(const Name* v) {                              \
+  return v->data[v->size - 1];                                                 \
+}                                                                              \
+                                                                               \
+static inline void prefix##_copy(Name* copy, const Name* v) {                  \
+  prefix##_init(copy);                                                         \
+  if (v->size == 0) return;                                                    \
+  prefix##_reserve(copy, v->size);                                             \
+  memcpy(copy->data, v->data, v->size * sizeof(type));                        \
+  copy->size = v->size;                                                        \
+}                                                                              \
+                                                                               \
+static inline void prefix##_clear(Name* v) {                                   \
+  v->size = 0;                                                                 \
+}                                                                              \
+                                                                               \
+static inline void prefix##_free(Name* v) {                                    \
+  free(v->data);                                                               \
+  prefix##_init(v);                                                            \
+}
+
+DEFINE_VECTOR(CharVector, cv, char)
+
+/**
+ * Copy the characters of a vector into a new null terminated string.
+ */
+static inline char* cv_to_string(const CharVector* v) {
+  char* string = malloc(v->size + 1);
+  if (v->size > 0) memcpy(string, v->data, v->size);
+  string[v->size] = '\0';
+  return string;
+}
+
+#endif